@@ -11,6 +11,7 @@ complete -c nsst -l "alternate-scroll" -x -a "true false default" -d "Scrolling
 complete -c nsst -l "answerback-string" -r -d "ENQ report"
 complete -c nsst -l "appcursor" -x -a "true false default" -d "Initial application cursor mode value"
 complete -c nsst -l "appkey" -x -a "true false default" -d "Initial application keypad mode value"
+complete -c nsst -l "async-rasterization" -x -a "true false default" -d "Rasterize new glyphs in a background thread"
 complete -c nsst -l "autorepeat" -x -a "true false default" -d "Enable key autorepeat"
 complete -c nsst -l "autowrap" -x -a "true false default" -d "Initial autowrap setting"
 complete -c nsst -l "backend" -x -a "auto x11 wayland x11xrender x11shm waylandshm default" -d "Select rendering backend"
@@ -36,14 +37,19 @@ complete -c nsst -l "cursor-shape" -x -a "blinking-block block blinking-underlin
 complete -c nsst -l "cursor-width" -r -d "Width of lines that forms cursor"
 complete -c nsst -l "cwd" -r -d "Current working directory for an application"
 complete -c nsst -l "daemon" -s d -d "Start terminal as daemon"
+complete -c nsst -l "daemon-shards" -r -d "Number of daemon worker processes, 0 for one per CPU"
 complete -c nsst -l "delete-is-del" -x -a "true false default" -d "Delete sends DEL symbol instead of escape sequence"
+complete -c nsst -l "detach-on-close" -x -a "true false default" -d "Keep the terminal running when its window is closed"
+complete -c nsst -l "double-buffer" -x -a "true false default" -d "Use two shared memory buffers and drop frames while X server is busy"
 complete -c nsst -l "double-click-time" -r -d "Time gap in microseconds in witch two mouse presses will be considered double"
 complete -c nsst -l "dpi" -r -d "DPI value for fonts"
 complete -c nsst -l "erase-scrollback" -x -a "true false default" -d "Allow ED 3 to clear scrollback buffer"
 complete -c nsst -l "extended-cir" -x -a "true false default" -d "Report all SGR attributes in DECCIR"
+complete -c nsst -l "fallback-disk-cache" -x -a "true false default" -d "Remember fallback fonts for missing characters between runs"
 complete -c nsst -l "fixed" -x -a "true false default" -d "Don't allow to change window size, if supported"
 complete -c nsst -l "fkey-increment" -r -d "Step in numbering function keys"
 complete -c nsst -l "font-cache-size" -r -d "Number of cached glyphs per font"
+complete -c nsst -l "font-keep-time" -r -d "Time to keep fonts cached after the last window using them is closed"
 complete -c nsst -l "font-gamma" -r -d "Factor of font sharpening"
 complete -c nsst -l "font-size" -r -d "Font size in points"
 complete -c nsst -l "font-size-step" -r -d "Font size step in points"
@@ -56,6 +62,7 @@ complete -c nsst -l "foreground" -r -d "Default foreground color"
 complete -c nsst -l "fork" -x -a "true false default" -d "Fork in daemon mode"
 complete -c nsst -l "fps" -r -d "Window refresh rate"
 complete -c nsst -l "frame-wait-delay" -r -d "Maximal time since last application output before redraw"
+complete -c nsst -l "glyph-disk-cache" -x -a "true false default" -d "Store rendered glyphs on disk to speed up startup"
 complete -c nsst -l "geometry" -x -s g -d "Window geometry in pixels"
 complete -c nsst -l "has-meta" -x -a "true false default" -d "Handle meta/alt"
 complete -c nsst -l "help" -s h -d "Print this message and exit"
@@ -116,11 +123,13 @@ complete -c nsst -l "page-amount" -r -d "Number of lines scrolled in a time by -
 complete -c nsst -l "pixel-mode" -x -a "mono bgr rgb bgrv rgbv default" -d "Sub-pixel rendering mode"
 complete -c nsst -l "pointer-hide-on-input" -x -a "true false default" -d "Hide mouse pointer during typing"
 complete -c nsst -l "pointer-hide-time" -r -d "Mouse pointer hiding duration"
+complete -c nsst -l "prewarm-glyphs" -r -d "Code point ranges to rasterize in background"
 complete -c nsst -l "pointer-shape" -r -a "(ls /usr/share/icons/*/cursors | grep -v cursors: | sort -u)" -d "Default mouse pointer shape for the window"
 complete -c nsst -l "print-attributes" -x -a "true false default" -d "Print cell attributes when printing is enabled"
 complete -c nsst -l "print-command" -r -d "Program to pipe CSI MC output into"
 complete -c nsst -l "printer-file" -r -s o -d "File where CSI MC output to"
 complete -c nsst -l "raise-on-bell" -x -a "true false default" -d "Raise terminal window on bell"
+complete -c nsst -l "read-quantum" -r -d "Parsing and rendering time budget of background windows while typing"
 complete -c nsst -l "resize-pointer-shape" -r -a "(ls /usr/share/icons/*/cursors | grep -v cursors: | sort -u)" -d "Mouse pointer shape for window resizing"
 complete -c nsst -l "reversed-color" -r -d "Special color of reversed text"
 complete -c nsst -l "reverse-video" -x -a "true false default" -d "Initial reverse video setting"
@@ -157,6 +166,7 @@ complete -c nsst -l "trace-controls" -x -a "true false default" -d "Trace interp
 complete -c nsst -l "trace-events" -x -a "true false default" -d "Trace received events"
 complete -c nsst -l "trace-fonts" -x -a "true false default" -d "Log font related information"
 complete -c nsst -l "trace-input" -x -a "true false default" -d "Trace user input"
+complete -c nsst -l "trace-latency" -x -a "true false default" -d "Trace keypress to display latency"
 complete -c nsst -l "trace-misc" -x -a "true false default" -d "Trace miscellaneous information"
 complete -c nsst -l "trace-poller" -x -a "true false default" -d "Trace poller events"
 complete -c nsst -l "triple-click-time" -r -d "Time gap in microseconds in witch tree mouse presses will be considered triple"
@@ -173,13 +183,18 @@ complete -c nsst -l "use-utf8" -x -a "true false default" -d "Enable UTF-8 I/O"
 complete -c nsst -l "version" -s v -d "Print version and exit"
 complete -c nsst -l "vertical-border" -r -d "Vertical border size (deprecated)"
 complete -c nsst -l "visual-bell-time" -r -d "Length of visual bell"
+complete -c nsst -l "vsync" -x -a "true false default" -d "Synchronize redraws with display refresh, if supported"
 complete -c nsst -l "visual-bell" -x -a "true false default" -d "Whether bell should be visual or normal"
 complete -c nsst -l "vt-version" -x -s t -d "Emulated VT version"
 complete -c nsst -l "wait-for-configure-delay" -r -d "Time gap in microseconds waiting for configure after resize request"
 complete -c nsst -l "window-class" -x -s V -d "X11 Window class"
+complete -c nsst -l "window-pool-size" -r -d "Number of pre-created windows per launch profile"
 complete -c nsst -l "window-ops" -x -a "true false default" -d "Allow window manipulation with escape sequences"
 complete -c nsst -l "word-break" -r -d "Symbols treated as word separators when snapping mouse selection"
 complete -c nsst -l "workspace" -r -d "Workspace to spawn window on (X11-only)"
 
 complete -c nsstc -w nsst
 complete -c nsstc -l "quit" -d "Quit the daemon"
+complete -c nsstc -l "stats" -d "Print performance statistics"
+complete -c nsstc -l "list" -d "Print detached windows"
+complete -c nsstc -l "attach" -r -d "Attach detached window"
@@ -17,6 +17,7 @@
 #include <inttypes.h>
 #include <langinfo.h>
 #include <limits.h>
+#include <locale.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -251,6 +252,7 @@ static struct option options[] = {
     X(string, answerback_string, "answerback-string", "ENQ report", "\006"),
     X(boolean, appcursor, "appcursor", "Initial application cursor mode value", false),
     X(boolean, appkey, "appkey", "Initial application keypad mode value", false),
+    GF(boolean, async_rasterization, "async-rasterization", "Rasterize new glyphs in a background thread", true),
     X(boolean, autorepeat, "autorepeat", "Enable key autorepeat", true),
     X(boolean, wrap, "autowrap", "Initial autowrap setting", true),
     GF(enum, backend, "backend", "Select rendering backend", renderer_auto, renderer_auto, XENUM("auto", "x11", "wayland", "x11xrender", "x11shm", "waylandshm")),
@@ -276,11 +278,15 @@ static struct option options[] = {
     X(boolean, cursor_hide_on_input, "cursor-hide-on-input", "Hide cursor during typing", false),
     X(string, cwd, "cwd", "Current working directory for an application", NULL),
     GF1(boolean, daemon_mode, 'd', "daemon", "Start terminal as daemon", false),
+    GF(int64, daemon_shards, "daemon-shards", "Number of daemon worker processes, 0 for one per CPU", 1, 0, 64),
+    X(boolean, detach_on_close, "detach-on-close", "Keep the terminal running in daemon mode when its window is closed", false),
     X(boolean, delete_is_delete, "delete-is-del", "Delete sends DEL symbol instead of escape sequence", false),
+    GF(boolean, double_buffer, "double-buffer", "Use two shared memory buffers and drop frames while X server is busy (x11shm only)", false),
     X(time, double_click_time, "double-click-time", "Maximum time between button presses of the double click", 300000000, 0, 10*SEC),
     X(double, dpi, "dpi", "DPI value for fonts", 96, 0, 1000),
     X(boolean, allow_erase_scrollback, "erase-scrollback", "Allow ED 3 to clear scrollback buffer", true),
     X(boolean, extended_cir, "extended-cir", "Report all SGR attributes in DECCIR", true),
+    G(boolean, fallback_disk_cache, "fallback-disk-cache", "Remember fallback fonts for missing characters between runs", true),
     X(boolean, fixed, "fixed", "Don't allow to change window size, if supported", false),
     X(uint8, fkey_increment, "fkey-increment", "Step in numbering function keys", 10, 0, 48),
     X(double, gamma, "font-gamma", "Factor of font sharpening", 1, 0.2, 2),
@@ -288,6 +294,7 @@ static struct option options[] = {
     X(dim, font_size, "font-size", "Font size in points", 0, 1, 1000),
     X(dim, font_spacing, "font-spacing", "Additional spacing for individual symbols", 0, -100, 100),
     G(int64, font_cache_size, "font-cache-size", "Number of cached glyphs", 5000, 200, 10000000),
+    G(time, font_keep_time, "font-keep-time", "Time to keep fonts cached after the last window using them is closed", 5*60*SEC, 0, 24*3600*SEC),
     X1(string, font_name, 'f', "font", "Comma-separated list of fontconfig font patterns", "mono"),
     X(boolean, force_utf8_nrcs, "force-nrcs", "Enable NRCS translation when UTF-8 mode is enabled", false),
     X(boolean, force_scalable, "force-scalable", "Do not search for pixmap fonts", false),
@@ -296,6 +303,7 @@ static struct option options[] = {
     GF(boolean, fork, "fork", "Fork in daemon mode", 1),
     X(int64, fps, "fps", "Window refresh rate", 60, 2, 1000),
     X(time, frame_finished_delay, "frame-wait-delay", "Maximum time since last application output before redraw", SEC/240, 1000, 10*SEC),
+    G(boolean, glyph_disk_cache, "glyph-disk-cache", "Store rendered glyphs on disk to speed up startup", true),
     X1(geometry, geometry, 'g', "geometry", "Window geometry, format is [=][<width>{xX}<height>][{+-}<xoffset>{+-}<yoffset>]", false),
     X(boolean, has_meta, "has-meta", "Handle meta/alt", true),
     X(string, icon_path, "icon-path", "Window icon file path", NULL),
@@ -355,10 +363,12 @@ static struct option options[] = {
     X(string, normal_pointer, "pointer-shape", "Default mouse pointer shape", NULL),
     X(boolean, pointer_hide_on_input, "pointer-hide-on-input", "Hide mouse pointer during typing", false),
     X(time, pointer_inhibit_time, "pointer-hide-time", "Mouse pointer hiding duration", SEC/2, 500000, 10*SEC),
+    GF(string, prewarm_glyphs, "prewarm-glyphs", "Hexadecimal code point ranges to rasterize in background for new fonts", NULL),
     X(boolean, print_attr, "print-attributes", "Print cell attributes when printing is enabled", true),
     X(string, printer_cmd, "print-command", "Program to pipe CSI MC output into", NULL),
     X1(string, printer_file, 'o', "printer-file", "File to which CSI MC output goes", NULL),
     X(boolean, raise_on_bell, "raise-on-bell", "Raise terminal window on bell", false),
+    G(time, read_quantum, "read-quantum", "Parsing and rendering time budget of background windows while typing", 2*SEC/1000, 0, SEC),
     X(string, resize_pointer, "resize-pointer-shape", "Mouse pointer shape for window resizing", NULL),
     X(string, exit_string, "on-exit-message", "Message to be printed when application has terminated", NULL),
     X(color, palette[SPECIAL_REVERSE], "reversed-color", "Special color of reversed text", COLOR_SPECIAL_REVERSE),
@@ -396,6 +406,7 @@ static struct option options[] = {
     G(boolean, trace_events, "trace-events", "Trace received events", false),
     G(boolean, trace_fonts, "trace-fonts", "Log font related information", false),
     G(boolean, trace_input, "trace-input", "Trace user input", false),
+    G(boolean, trace_latency, "trace-latency", "Trace keypress to display latency", false),
     G(boolean, trace_misc, "trace-misc", "Trace miscellaneous information", false),
     G(boolean, trace_poller, "trace-poller", "Trace poller events", false),
     X(time, triple_click_time, "triple-click-time", "Maximum time between second and third button presses of the triple click", 600000000, 0, 10*SEC),
@@ -412,9 +423,11 @@ static struct option options[] = {
     X(vertical_border, border, "vertical-border", "Vertical border size (deprecated)", -1, 0, 200),
     X(time, visual_bell_time, "visual-bell-time", "Duration of the visual bell", 200000000, 0, 10*SEC),
     X(boolean, visual_bell, "visual-bell", "Whether bell should be visual or normal", false),
+    X(boolean, vsync, "vsync", "Synchronize redraws with display refresh, if supported", true),
     X1(int16, vt_version, 'V', "vt-version", "Emulated VT version", 420, 0, 999),
     X(time, wait_for_configure_delay, "wait-for-configure-delay", "Duration terminal waits for application output before redraw after window resize", 2000000, 0, 10*SEC),
     X1(string, window_class, 'c', "window-class", "X11 Window class", NULL),
+    G(int64, window_pool_size, "window-pool-size", "Number of windows created ahead of time for each launch profile in daemon mode", 0, 0, 16),
     X(boolean, allow_window_ops, "window-ops", "Allow window manipulation with escape sequences", true),
     X(string, word_separators, "word-break", "Symbols treated as word separators when snapping mouse selection", " \t!$^*()+={}[]\\\"'|,;<>~`"),
     X(int16, workspace, "workspace", "Workspace to spawn window on (X11-only)", -1, 0, 1000),
@@ -464,6 +477,39 @@ void free_options(void) {
     free(default_config_path);
 }
 
+/* Characters that are likely to be used
+ * in addition to ASCII for common languages */
+static const struct {
+    const char *lang;
+    const char *ranges;
+} lang_ranges[] = {
+    {"be", "400-45f"}, {"bg", "400-45f"}, {"kk", "400-4ff"}, {"mk", "400-45f"},
+    {"ru", "400-45f"}, {"sr", "400-45f,100-17f"}, {"uk", "400-45f,490-491"},
+    {"cs", "100-17f"}, {"et", "100-17f"}, {"hr", "100-17f"}, {"hu", "100-17f"},
+    {"lt", "100-17f"}, {"lv", "100-17f"}, {"pl", "100-17f"}, {"ro", "100-17f,218-21b"},
+    {"sk", "100-17f"}, {"sl", "100-17f"}, {"tr", "100-17f"},
+    {"el", "370-3ff"}, {"he", "5d0-5ea"}, {"vi", "1a0-1b0,300-303,1ea0-1ef9"},
+    {"ja", "3000-303f,3040-30ff,ff01-ff9f"},
+};
+
+static const char *default_prewarm_glyphs(bool utf8) {
+    static char buffer[128];
+    if (!utf8) return "20-7e,a0-ff";
+
+    /* Latin-1, box drawing, block elements and Powerline symbols */
+    size_t len = snprintf(buffer, sizeof buffer, "20-7e,a0-ff,2500-259f,e0a0-e0a3,e0b0-e0b3");
+
+    const char *locale = setlocale(LC_CTYPE, NULL);
+    for (size_t i = 0; locale && i < LEN(lang_ranges); i++) {
+        if (!strncmp(locale, lang_ranges[i].lang, 2) && !isalpha((unsigned char)locale[2])) {
+            snprintf(buffer + len, sizeof buffer - len, ",%s", lang_ranges[i].ranges);
+            break;
+        }
+    }
+
+    return buffer;
+}
+
 void init_options(const char *config_path) {
     if (config_path)
         default_config_path = strdup(config_path);
@@ -538,6 +584,9 @@ void init_options(const char *config_path) {
         struct option *opt = find_option_entry("use-utf8", true);
         opt->limits.arg_boolean.dflt = utf8;
 
+        opt = find_option_entry("prewarm-glyphs", true);
+        opt->limits.arg_string.dflt = default_prewarm_glyphs(utf8);
+
         gconfig.want_luit = !supported && !utf8;
     }
 
@@ -76,8 +76,13 @@ enum uri_mode {
 
 struct global_config {
     uint64_t font_cache_size;
+    int64_t font_keep_time;
+    int64_t read_quantum;
+    int64_t daemon_shards;
+    int64_t window_pool_size;
 
     char *sockpath;
+    char *prewarm_glyphs;
     char hostname[MAX_DOMAIN_NAME];
 
     enum renderer_backend backend;
@@ -86,12 +91,17 @@ struct global_config {
 
     bool unique_uris;
     bool daemon_mode;
+    bool double_buffer;
+    bool async_rasterization;
+    bool glyph_disk_cache;
+    bool fallback_disk_cache;
     bool clone_config;
     bool trace_characters;
     bool trace_controls;
     bool trace_events;
     bool trace_fonts;
     bool trace_input;
+    bool trace_latency;
     bool trace_misc;
     bool trace_poller;
     bool want_luit;
@@ -230,6 +240,7 @@ struct instance_config {
     bool blend_fg;
     bool cursor_hide_on_input;
     bool delete_is_delete;
+    bool detach_on_close;
     bool extended_cir;
     bool fixed;
     bool force_scalable;
@@ -260,6 +271,7 @@ struct instance_config {
     bool urgency_on_bell;
     bool utf8;
     bool visual_bell;
+    bool vsync;
     bool wrap;
 };
 
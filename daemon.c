@@ -1,4 +1,4 @@
-/* Copyright (c) 2019-2022, Evgeniy Baskov. All rights reserved */
+/* Copyright (c) 2019-2022,2026, Evgeniy Baskov. All rights reserved */
 
 #include "feature.h"
 
@@ -10,23 +10,33 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <poll.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #define MAX_ARG_LEN 512
 #define INIT_ARGN 4
 #define ARGN_STEP(x) (MAX(INIT_ARGN, 3*(x)/2))
 #define NUM_PENDING 8
+#define MAX_SHARDS 64
+/* Limit for the size of batched launch request */
+#define MAX_LAUNCH_SIZE (1 << 20)
 
 static void handle_launch(void *data_, uint32_t mask);
 static void handle_daemon(void *data_, uint32_t mask);
+static void handle_shard(void *data_, uint32_t mask);
+static void handle_dispatcher(void *data_, uint32_t mask);
 
 struct pending_launch {
     struct list_head link;
@@ -36,12 +46,68 @@ struct pending_launch {
     int fd;
     char **args;
     struct instance_config cfg;
+    /* Request was sent as a single message,
+     * client expects an acknowledgment */
+    bool batched;
+    /* Request sets options other than the title or the working
+     * directory, so it cannot get a window from the pool */
+    bool customized;
+};
+
+/* With --daemon-shards the daemon consists of a dispatcher process,
+ * which only accepts client connections, and worker processes (shards),
+ * each with its own display connection, caches and event loop.
+ * Accepted connections are passed to the least loaded shard. */
+
+enum shard_msg_type {
+    /* Dispatcher -> shard: new client connection */
+    shard_msg_launch,
+    /* Dispatcher -> shard: print statistics to the client */
+    shard_msg_stats,
+    /* Shard -> dispatcher: statistics are printed, pass the client to the next shard */
+    shard_msg_stats_done,
+    /* Shard -> dispatcher: number of windows */
+    shard_msg_load,
+    /* Shard -> dispatcher: client requested daemon exit */
+    shard_msg_quit,
+    /* Dispatcher -> shard: print detached windows to the client */
+    shard_msg_list,
+    /* Shard -> dispatcher: detached windows are printed, pass the client to the next shard */
+    shard_msg_list_done,
+    /* Both directions: attach the window with the given ID,
+     * shards pass requests for other shards to the dispatcher */
+    shard_msg_attach,
+};
+
+struct shard_msg {
+    uint32_t type;
+    int64_t value;
+};
+
+struct shard {
+    struct event *evt;
+    int fd;
+    pid_t pid;
+    ssize_t load;
+};
+
+enum daemon_role {
+    daemon_single,
+    daemon_dispatcher,
+    daemon_shard,
 };
 
 struct daemon_context {
     struct list_head pending_launches;
     struct event *socket_event;
     int socket_fd;
+
+    enum daemon_role role;
+    /* Worker processes for the dispatcher,
+     * connection to the dispatcher for shards */
+    struct shard shards[MAX_SHARDS];
+    ssize_t shard_count;
+    ssize_t shard_index;
 };
 
 static struct daemon_context ctx;
@@ -72,10 +138,111 @@ static void daemonize(void) {
 }
 
 
-bool init_daemon(void) {
-    list_init(&ctx.pending_launches);
-    ctx.socket_fd = -1;
+static bool send_shard_msg(int fd, enum shard_msg_type type, int64_t value, int pass_fd) {
+    struct shard_msg msg = { .type = type, .value = value };
+    struct iovec iov = { .iov_base = &msg, .iov_len = sizeof msg };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } cbuf;
+    struct msghdr hdr = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+    if (pass_fd >= 0) {
+        memset(&cbuf, 0, sizeof cbuf);
+        hdr.msg_control = cbuf.buf;
+        hdr.msg_controllen = sizeof cbuf.buf;
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+    }
+
+    if (sendmsg(fd, &hdr, MSG_NOSIGNAL) < 0) {
+        warn("Can't send message to %s: %s", ctx.role == daemon_shard ? "dispatcher" : "shard", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static bool recv_shard_msg(int fd, struct shard_msg *msg, int *pfd) {
+    struct iovec iov = { .iov_base = msg, .iov_len = sizeof *msg };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } cbuf;
+    struct msghdr hdr = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = cbuf.buf,
+        .msg_controllen = sizeof cbuf.buf,
+    };
+
+    *pfd = -1;
+    ssize_t res = recvmsg(fd, &hdr, MSG_CMSG_CLOEXEC);
+    if (res < 0) {
+        if (errno != EAGAIN && errno != EINTR)
+            warn("Can't receive message from %s: %s", ctx.role == daemon_shard ? "dispatcher" : "shard", strerror(errno));
+        return false;
+    }
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        memcpy(pfd, CMSG_DATA(cmsg), sizeof(int));
 
+    if (res != sizeof *msg) {
+        /* Zero length means that the other side has closed the connection */
+        if (res) warn("Malformed message from %s", ctx.role == daemon_shard ? "dispatcher" : "shard");
+        if (*pfd >= 0) close(*pfd);
+        errno = EPIPE;
+        return false;
+    }
+    return true;
+}
+
+static void spawn_shards(ssize_t count) {
+    for (ssize_t i = 0; i < count; i++) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+            warn("Can't create shard socket: %s", strerror(errno));
+            break;
+        }
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            warn("Can't fork() shard: %s", strerror(errno));
+            close(fds[0]);
+            close(fds[1]);
+            break;
+        }
+
+        if (!pid) {
+            /* Shard only needs its own connection to the dispatcher */
+            for (ssize_t j = 0; j < ctx.shard_count; j++)
+                close(ctx.shards[j].fd);
+            close(fds[0]);
+            close(ctx.socket_fd);
+            ctx.socket_fd = -1;
+
+            ctx.role = daemon_shard;
+            ctx.shard_index = i;
+            ctx.shards[0] = (struct shard) { .fd = fds[1], .pid = getppid() };
+            ctx.shard_count = 1;
+            return;
+        }
+
+        close(fds[1]);
+        ctx.shards[ctx.shard_count++] = (struct shard) { .fd = fds[0], .pid = pid };
+    }
+
+    ctx.role = ctx.shard_count ? daemon_dispatcher : daemon_single;
+}
+
+bool daemon_is_dispatcher(void) {
+    return ctx.role == daemon_dispatcher;
+}
+
+static bool open_daemon_socket(void) {
     struct sockaddr_un addr;
     memset(&addr, 0, sizeof addr);
     addr.sun_family = AF_UNIX;
@@ -104,18 +271,95 @@ bool init_daemon(void) {
     }
 
     ctx.socket_fd = fd;
-    ctx.socket_event = poller_add_fd(handle_daemon, NULL, fd, POLLIN);
-    poller_set_autoreset(ctx.socket_event, &ctx.socket_event);
+    return true;
+}
+
+bool init_daemon(void) {
+    list_init(&ctx.pending_launches);
+    ctx.socket_fd = -1;
+    ctx.role = daemon_single;
+
+    ssize_t shards = gconfig.daemon_shards;
+    if (!shards) shards = sysconf(_SC_NPROCESSORS_ONLN);
+    shards = MIN(MAX(shards, 1), MAX_SHARDS);
+
+    /* Single process daemon creates the socket in start_daemon(),
+     * after the display connection is made and free_daemon() is
+     * registered, so the socket file is not left behind on failure */
+    if (shards == 1) return true;
+
+    /* Shards are forked before the poller and the display
+     * connection are initialized, so nothing is shared between them.
+     * The socket is created first, so that only one dispatcher can run */
+    if (!open_daemon_socket())
+        return false;
 
     if (gconfig.fork) daemonize();
+    spawn_shards(shards);
+    return true;
+}
+
+static void handle_dispatcher_term(int sig) {
+    (void)sig;
+    poller_stop();
+}
+
+bool start_daemon(void) {
+    switch (ctx.role) {
+    case daemon_dispatcher:;
+        /* Dispatcher does not have windows, so it needs its own handlers
+         * to remove the socket on exit */
+        struct sigaction sa = { .sa_handler = handle_dispatcher_term };
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGTERM, &sa, NULL);
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGHUP, &sa, NULL);
+
+        for (ssize_t i = 0; i < ctx.shard_count; i++) {
+            ctx.shards[i].evt = poller_add_fd(handle_shard, &ctx.shards[i], ctx.shards[i].fd, POLLIN);
+            poller_set_autoreset(ctx.shards[i].evt, &ctx.shards[i].evt);
+        }
+        /* fallthrough */
+    case daemon_single:
+        if (ctx.socket_fd < 0 && !open_daemon_socket())
+            return false;
+        ctx.socket_event = poller_add_fd(handle_daemon, NULL, ctx.socket_fd, POLLIN);
+        poller_set_autoreset(ctx.socket_event, &ctx.socket_event);
+        /* Single process daemon forks after connecting to the display,
+         * so that errors are reported by the exit code */
+        if (ctx.role == daemon_single && gconfig.fork) daemonize();
+        break;
+    case daemon_shard:
+        ctx.shards[0].evt = poller_add_fd(handle_dispatcher, NULL, ctx.shards[0].fd, POLLIN);
+        poller_set_autoreset(ctx.shards[0].evt, &ctx.shards[0].evt);
+        break;
+    }
     return true;
 }
 
+static void remove_shard(struct shard *shard) {
+    poller_unset(&shard->evt);
+    if (shard->fd >= 0) {
+        close(shard->fd);
+        shard->fd = -1;
+    }
+    if (ctx.role == daemon_dispatcher && shard->pid > 0) {
+        waitpid(shard->pid, NULL, WNOHANG);
+        shard->pid = -1;
+    }
+}
+
+/* Called by shards when the number of windows changes */
+void daemon_report_load(void) {
+    if (ctx.role != daemon_shard || ctx.shards[0].fd < 0) return;
+    send_shard_msg(ctx.shards[0].fd, shard_msg_load, window_count(), -1);
+}
+
 static void free_pending_launch(struct pending_launch *lnch) {
     list_remove(&lnch->link);
 
-    close(lnch->fd);
     poller_remove(lnch->evt);
+    close(lnch->fd);
 
     for (ssize_t i = 0; i < lnch->argn; i++)
         free(lnch->args[i]);
@@ -133,11 +377,18 @@ void free_daemon(void) {
 
     poller_unset(&ctx.socket_event);
 
-    if (ctx.socket_fd > 0) {
+    /* Shards exit when the connection to the dispatcher is closed */
+    for (ssize_t i = 0; i < ctx.shard_count; i++)
+        remove_shard(&ctx.shards[i]);
+    ctx.shard_count = 0;
+
+    /* Only the process owning the socket removes it, it might
+     * belong to another daemon if it could not be created */
+    if (ctx.socket_fd >= 0) {
         close(ctx.socket_fd);
         ctx.socket_fd = -1;
+        unlink(gconfig.sockpath);
     }
-    unlink(gconfig.sockpath);
     gconfig.daemon_mode = false;
 }
 
@@ -150,18 +401,58 @@ static bool send_pending_launch_resp(struct pending_launch *lnch, const char *st
     return 1;
 }
 
-static void append_pending_launch(struct pending_launch *lnch) {
-    char buffer[MAX(MAX_ARG_LEN, MAX_OPTION_DESC) + 1];
+static bool send_text_resp(void *pfd_, const char *str) {
+    int *pfd = pfd_;
+    if (send(*pfd, str, strlen(str), 0) < 0) {
+        warn("Can't send statistics to client");
+        return false;
+    }
+    return true;
+}
 
-    ssize_t len = recv(lnch->fd, buffer, MAX_ARG_LEN, 0);
-    if (len < 0) {
-        warn("Can't recv argument: %s", strerror(errno));
-        free_pending_launch(lnch);
+uint64_t daemon_window_id(struct window *win) {
+    uint64_t id = window_id(win);
+    /* Make IDs unique across shards */
+    if (ctx.role == daemon_shard)
+        id = id*MAX_SHARDS + ctx.shard_index;
+    return id;
+}
+
+static void send_launch_ack(int fd, struct window *win) {
+    char buffer[32] = "\025" /* NAK */;
+
+    if (win)
+        snprintf(buffer, sizeof buffer, "\006%"PRIu64 /* ACK */, daemon_window_id(win));
+
+    if (send(fd, buffer, strlen(buffer), MSG_NOSIGNAL) < 0)
+        warn("Can't send acknowledgment to client: %s", strerror(errno));
+}
+
+/* Takes ownership of the client fd */
+static void attach_window(int fd, uint64_t id) {
+    if (ctx.role == daemon_shard && id % MAX_SHARDS != (uint64_t)ctx.shard_index) {
+        /* Window belongs to other shard */
+        send_shard_msg(ctx.shards[0].fd, shard_msg_attach, id, fd);
+        close(fd);
         return;
     }
 
-    buffer[len] = '\0';
+    if (ctx.role == daemon_shard)
+        id /= MAX_SHARDS;
 
+    struct window *win = id <= UINT32_MAX ? window_attach(id) : NULL;
+    if (win) daemon_report_load();
+    send_launch_ack(fd, win);
+    close(fd);
+}
+
+static void note_launch_option(struct pending_launch *lnch, struct option *opt) {
+    if (opt && opt != find_option_entry("title", false) && opt != find_option_entry("cwd", false))
+        lnch->customized = true;
+}
+
+/* Returns false if the pending launch was freed */
+static bool handle_launch_record(struct pending_launch *lnch, char *buffer, ssize_t len) {
     if (buffer[0] == '\001' /* SOH */) /* Header */ {
         char *cpath = len > 1 ? buffer + 1 : NULL;
         if (!cpath && gconfig.clone_config)
@@ -171,27 +462,37 @@ static void append_pending_launch(struct pending_launch *lnch) {
     } else if (buffer[0] == '\003' /* ETX */ && len == 1) /* End of configuration */ {
         if (lnch->args) lnch->args[lnch->argn] = NULL;
         lnch->cfg.argv = lnch->args;
-        create_window(&lnch->cfg);
+        struct window *win = NULL;
+        if (!lnch->args && !lnch->customized)
+            win = window_pool_take(&lnch->cfg);
+        if (!win)
+            win = create_window(&lnch->cfg);
+        daemon_report_load();
+        if (lnch->batched)
+            send_launch_ack(lnch->fd, win);
         free_pending_launch(lnch);
+        return false;
     } else if (buffer[0] == '\034' /* FS */ && len > 1) /* Short option */ {
         char *name = buffer + 1, *value = memchr(buffer + 1, '=', len);
         if (!value || name + 1 != value) {
             warn("Wrong option format: '%s'", name);
-            return;
+            return true;
         }
 
         struct option *opt = find_short_option_entry(*name);
         if (opt) set_option_entry(&lnch->cfg, opt, value, 0);
+        note_launch_option(lnch, opt);
     } else if (buffer[0] == '\035' /* GS */ && len > 1) /* Option */ {
         char *name = buffer + 1, *value = memchr(buffer + 1, '=', len);
         if (!value) {
             warn("Wrong option format: '%s'", name);
-            return;
+            return true;
         }
 
         *value++ = '\0';
         struct option *opt = find_option_entry(name, true);
         if (opt) set_option_entry(&lnch->cfg, opt, value, 0);
+        note_launch_option(lnch, opt);
     } else if (buffer[0] == '\036' /* RS */ && len > 1) /* Argument */ {
         if (lnch->argn + 2 > lnch->argcap) {
             ssize_t newsz = ARGN_STEP(lnch->argcap);
@@ -204,26 +505,122 @@ static void append_pending_launch(struct pending_launch *lnch) {
         const char *resps[] = {version_string(), "Features: ", features_string()};
 
         for (size_t i = 0; i < LEN(resps); i++)
-            if (!send_pending_launch_resp(lnch, resps[i])) return; /* Don't free pending_launch twice */
+            if (!send_pending_launch_resp(lnch, resps[i])) return false; /* Don't free pending_launch twice */
 
         free_pending_launch(lnch);
+        return false;
     } else if (buffer[0] == '\025' /* NAK */ && len == 1) /* Usage text request */ {
+        char desc[MAX_OPTION_DESC + 1];
         ssize_t i = 0;
-        for (const char *part; (part = usage_string(buffer, i++));)
-            if (!send_pending_launch_resp(lnch, part)) return; /* Don't free pending_launch twice */
+        for (const char *part; (part = usage_string(desc, i++));)
+            if (!send_pending_launch_resp(lnch, part)) return false; /* Don't free pending_launch twice */
 
         free_pending_launch(lnch);
+        return false;
+    } else if (buffer[0] == '\022' /* DC2 */ && len == 1) /* Statistics request */ {
+        /* Dispatcher passes the client to every shard in turn */
+        if (ctx.role == daemon_shard)
+            send_shard_msg(ctx.shards[0].fd, shard_msg_stats_done, -1, lnch->fd);
+        else
+            window_dump_stats(send_text_resp, &lnch->fd);
+        free_pending_launch(lnch);
+        return false;
+    } else if (buffer[0] == '\024' /* DC4 */ && len == 1) /* Detached windows list request */ {
+        if (ctx.role == daemon_shard)
+            send_shard_msg(ctx.shards[0].fd, shard_msg_list_done, -1, lnch->fd);
+        else
+            window_list_detached(send_text_resp, &lnch->fd);
+        free_pending_launch(lnch);
+        return false;
+    } else if (buffer[0] == '\023' /* DC3 */ && len > 1) /* Attach request */ {
+        char *end;
+        errno = 0;
+        uint64_t id = strtoull(buffer + 1, &end, 10);
+        if (errno || *end) {
+            warn("Wrong window ID: '%s'", buffer + 1);
+            send_launch_ack(lnch->fd, NULL);
+        } else {
+            attach_window(dup(lnch->fd), id);
+        }
+        free_pending_launch(lnch);
+        return false;
     } else if (buffer[0] == '\031' /* EM */ && len == 1) /* Exit daemon*/ {
-        poller_stop();
+        if (ctx.role == daemon_shard)
+            send_shard_msg(ctx.shards[0].fd, shard_msg_quit, 0, -1);
+        else
+            poller_stop();
         free_pending_launch(lnch);
+        return false;
     }
+
+    return true;
 }
 
-static void accept_pending_launch(void) {
-    int fd = accept(ctx.socket_fd, NULL, NULL);
+/* Batched request is a single message containing all records of the launch,
+ * each one is prefixed by its length and terminated by a NUL character:
+ *
+ *     STX { <uint32_t length> <record> NUL }...
+ *
+ * Records have the same format as if they were sent separately. */
+static void handle_batched_launch(struct pending_launch *lnch, ssize_t size) {
+    if (size > MAX_LAUNCH_SIZE) {
+        warn("Launch request is too long");
+        free_pending_launch(lnch);
+        return;
+    }
 
-    set_cloexec(fd);
+    char *data = xalloc(size);
+    if (recv(lnch->fd, data, size, 0) != size) {
+        warn("Can't recv launch request: %s", strerror(errno));
+        goto error;
+    }
+
+    lnch->batched = true;
 
+    for (char *pos = data + 1, *end = data + size; pos < end; ) {
+        uint32_t len;
+        if (end - pos < (ssize_t)sizeof len) break;
+        memcpy(&len, pos, sizeof len);
+        pos += sizeof len;
+
+        if (!len || (ssize_t)len >= end - pos || pos[len]) break;
+        if (!handle_launch_record(lnch, pos, len)) {
+            free(data);
+            return;
+        }
+        pos += len + 1;
+    }
+
+    /* Request should have been finished by ETX */
+    warn("Malformed launch request");
+    send_launch_ack(lnch->fd, NULL);
+error:
+    free(data);
+    free_pending_launch(lnch);
+}
+
+static void append_pending_launch(struct pending_launch *lnch) {
+    char buffer[MAX_ARG_LEN + 1];
+
+    /* Batched requests can be larger than the buffer, so check the type first */
+    ssize_t len = recv(lnch->fd, buffer, 1, MSG_PEEK | MSG_TRUNC);
+    if (len > 0 && buffer[0] == '\002' /* STX */) {
+        handle_batched_launch(lnch, len);
+        return;
+    }
+
+    len = recv(lnch->fd, buffer, MAX_ARG_LEN, 0);
+    if (len < 0) {
+        warn("Can't recv argument: %s", strerror(errno));
+        free_pending_launch(lnch);
+        return;
+    }
+
+    buffer[len] = '\0';
+    handle_launch_record(lnch, buffer, len);
+}
+
+static void add_pending_launch(int fd) {
     struct pending_launch *lnch = xzalloc(sizeof(struct pending_launch));
     if (fd < 0 || !(lnch->evt = poller_add_fd(handle_launch, lnch, fd, POLLIN))) {
         close(fd);
@@ -235,6 +632,135 @@ static void accept_pending_launch(void) {
     }
 }
 
+/* Passes the client to every shard in turn, each one prints its part of the response */
+static void dispatch_request(int fd, enum shard_msg_type type, ssize_t next) {
+    while (next < ctx.shard_count && ctx.shards[next].fd < 0) next++;
+
+    if (next < ctx.shard_count)
+        send_shard_msg(ctx.shards[next].fd, type, next, fd);
+    close(fd);
+}
+
+static void accept_pending_launch(void) {
+    int fd = accept(ctx.socket_fd, NULL, NULL);
+
+    set_cloexec(fd);
+
+    if (ctx.role != daemon_dispatcher) {
+        add_pending_launch(fd);
+        return;
+    }
+
+    if (fd < 0) {
+        warn("Can't accept client: %s", strerror(errno));
+        return;
+    }
+
+    struct shard *best = NULL;
+    for (ssize_t i = 0; i < ctx.shard_count; i++)
+        if (ctx.shards[i].fd >= 0 && (!best || ctx.shards[i].load < best->load))
+            best = &ctx.shards[i];
+
+    /* The shard will report the actual number of windows later,
+     * assume that the client creates a window for now */
+    if (best && send_shard_msg(best->fd, shard_msg_launch, 0, fd))
+        best->load++;
+    close(fd);
+}
+
+static void handle_shard(void *data_, uint32_t mask) {
+    struct shard *shard = data_;
+    struct shard_msg msg;
+    int fd;
+
+    if (!(mask & POLLIN) || !recv_shard_msg(shard->fd, &msg, &fd)) {
+        if (!(mask & POLLIN) || (errno != EAGAIN && errno != EINTR)) {
+            warn("Shard %zd exited", shard - ctx.shards);
+            remove_shard(shard);
+
+            bool any_alive = false;
+            for (ssize_t i = 0; i < ctx.shard_count; i++)
+                any_alive |= ctx.shards[i].fd >= 0;
+            if (!any_alive) poller_stop();
+        }
+        return;
+    }
+
+    switch (msg.type) {
+    case shard_msg_load:
+        shard->load = msg.value;
+        break;
+    case shard_msg_quit:
+        poller_stop();
+        break;
+    case shard_msg_stats_done:
+        if (fd >= 0) {
+            dispatch_request(fd, shard_msg_stats, msg.value + 1);
+            fd = -1;
+        }
+        break;
+    case shard_msg_list_done:
+        if (fd >= 0) {
+            dispatch_request(fd, shard_msg_list, msg.value + 1);
+            fd = -1;
+        }
+        break;
+    case shard_msg_attach:;
+        ssize_t target = msg.value >= 0 ? msg.value % MAX_SHARDS : -1;
+        if (fd < 0) break;
+        if (target < 0 || target >= ctx.shard_count || ctx.shards[target].fd < 0 ||
+                !send_shard_msg(ctx.shards[target].fd, shard_msg_attach, msg.value, fd))
+            send_launch_ack(fd, NULL);
+        break;
+    default:
+        warn("Unexpected message from shard %zd", shard - ctx.shards);
+    }
+
+    if (fd >= 0) close(fd);
+}
+
+static void handle_dispatcher(void *data_, uint32_t mask) {
+    (void)data_;
+    struct shard_msg msg;
+    int fd;
+
+    if (!(mask & POLLIN) || !recv_shard_msg(ctx.shards[0].fd, &msg, &fd)) {
+        /* Dispatcher exited, so does the whole daemon */
+        if (!(mask & POLLIN) || (errno != EAGAIN && errno != EINTR))
+            poller_stop();
+        return;
+    }
+
+    if (fd < 0) {
+        warn("Unexpected message from dispatcher");
+        return;
+    }
+
+    switch (msg.type) {
+    case shard_msg_launch:
+        add_pending_launch(fd);
+        return;
+    case shard_msg_stats:;
+        char name[32];
+        snprintf(name, sizeof name, "Shard %zd:\n", ctx.shard_index);
+        if (send_text_resp(&fd, name))
+            window_dump_stats(send_text_resp, &fd);
+        send_shard_msg(ctx.shards[0].fd, shard_msg_stats_done, msg.value, fd);
+        break;
+    case shard_msg_list:
+        window_list_detached(send_text_resp, &fd);
+        send_shard_msg(ctx.shards[0].fd, shard_msg_list_done, msg.value, fd);
+        break;
+    case shard_msg_attach:
+        attach_window(fd, msg.value);
+        return;
+    default:
+        warn("Unexpected message from dispatcher");
+    }
+
+    close(fd);
+}
+
 static void handle_launch(void *data_, uint32_t mask) {
     struct pending_launch *holder = data_;
 
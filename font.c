@@ -11,12 +11,21 @@
 #   include "boxdraw.h"
 #endif
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <math.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <fontconfig/fontconfig.h>
 #include <ft2build.h>
@@ -27,9 +36,49 @@
 #define CAPS_STEP 2
 #define HASH_INIT_CAP 167
 
+#define DISK_CACHE_MAGIC "NSSTGLY1"
+#define DISK_CACHE_MAX_SIZE (64 << 20)
+/* Limit for all glyph cache files together,
+ * least recently used files are removed first */
+#define DISK_CACHE_TOTAL_MAX_SIZE (256 << 20)
+#define DISK_CACHE_SUFFIX ".glyphs"
+
+#define FALLBACK_CACHE_MAGIC "NSSTFBK1"
+#define FALLBACK_CACHE_FILE "fallback"
+
+/* Result of fallback font search for a single code point,
+ * file is NULL if no installed font covers it */
+struct fallback_entry {
+    ht_head_t head;
+    uint32_t ch;
+    uint32_t style;
+    int index;
+    char *file;
+};
+
+/* Fonts previously selected as fallback, code points are
+ * matched against their character sets before asking fontconfig */
+struct fallback_font {
+    uint32_t style;
+    FcPattern *pat;
+    FcCharSet *charset;
+};
+
 struct font_context {
+    /* Protects FreeType library and faces, fontconfig
+     * and fallback cache from concurrent use by the main
+     * thread and rasterization thread */
+    pthread_mutex_t lock;
     size_t fonts;
     FT_Library library;
+
+    /* Fallback cache, shared between all fonts */
+    bool fallback_loaded;
+    int fallback_fd;
+    hashtable_t fallback;
+    struct fallback_font *fallback_fonts;
+    size_t fallback_fonts_count;
+    size_t fallback_fonts_caps;
 };
 
 struct face {
@@ -46,6 +95,9 @@ struct face {
 struct face_list {
     size_t length;
     size_t caps;
+    /* Number of faces loaded from the font description,
+     * the rest are substitutes loaded on demand */
+    size_t primary;
     hashtable_t face_ht;
     struct face **faces;
 };
@@ -67,10 +119,243 @@ struct pattern_holder {
     FcPattern **pats;
 };
 
-static struct font_context global;
+static struct font_context global = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static bool make_cache_dir(char *path) {
+    for (char *ptr = path + 1; *ptr; ptr++) {
+        if (*ptr != '/') continue;
+        *ptr = '\0';
+        int res = mkdir(path, 0700);
+        *ptr = '/';
+        if (res < 0 && errno != EEXIST) return false;
+    }
+    return mkdir(path, 0700) >= 0 || errno == EEXIST;
+}
+
+/* Returns path of the file in $XDG_CACHE_HOME/nsst or $HOME/.cache/nsst,
+ * creating the directory if necessary */
+static bool cache_file_path(const char *name, char path[static PATH_MAX]) {
+    const char *xdg_cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int len;
+
+    if (xdg_cache && *xdg_cache == '/')
+        len = snprintf(path, PATH_MAX, "%s/nsst", xdg_cache);
+    else if (home && *home == '/')
+        len = snprintf(path, PATH_MAX, "%s/.cache/nsst", home);
+    else
+        return false;
+
+    if (len < 0 || (size_t)len + strlen(name) + 2 > PATH_MAX) return false;
+
+    if (!make_cache_dir(path)) {
+        warn("Can't create cache directory '%s': %s", path, strerror(errno));
+        return false;
+    }
+
+    snprintf(path + len, PATH_MAX - len, "/%s", name);
+    return true;
+}
+
+/* Opens (creating if necessary) the cache file */
+static int open_cache_file(const char *name, char path[static PATH_MAX]) {
+    if (!cache_file_path(name, path)) return -1;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0)
+        warn("Can't open cache file '%s': %s", path, strerror(errno));
+    return fd;
+}
+
+#define mkfallbackkey(c, s) ((struct fallback_entry){ .head = { .hash = uint_hash32((c) ^ uint_hash32(s)) }, .ch = (c), .style = (s) })
+
+static bool fallback_cmp(const ht_head_t *a, const ht_head_t *b) {
+    const struct fallback_entry *ea = (const struct fallback_entry *)a;
+    const struct fallback_entry *eb = (const struct fallback_entry *)b;
+    return ea->ch == eb->ch && ea->style == eb->style;
+}
+
+static struct fallback_entry *fallback_insert(uint32_t ch, uint32_t style, const char *file, int index) {
+    struct fallback_entry dummy = mkfallbackkey(ch, style);
+    ht_head_t **h = ht_lookup_ptr(&global.fallback, &dummy.head);
+    if (*h) return (struct fallback_entry *)*h;
+
+    struct fallback_entry *entry = xalloc(sizeof *entry);
+    *entry = dummy;
+    entry->index = index;
+    entry->file = file ? strdup(file) : NULL;
+    ht_insert_hint(&global.fallback, h, &entry->head);
+    return entry;
+}
+
+/* Fontconfig matching results depend on its configuration
+ * and on the set of installed fonts, so the persistent
+ * cache is keyed by modification times of both */
+static uint64_t fallback_cache_key(void) {
+    uint64_t key = hash64(FALLBACK_CACHE_MAGIC, sizeof FALLBACK_CACHE_MAGIC - 1);
+    FcStrList *lists[] = { FcConfigGetFontDirs(NULL), FcConfigGetConfigFiles(NULL) };
+
+    for (size_t i = 0; i < LEN(lists); i++) {
+        if (!lists[i]) continue;
+        for (FcChar8 *str; (str = FcStrListNext(lists[i])); ) {
+            struct stat stt;
+            key = uint_hash64(key ^ hash64(str, strlen((char *)str)));
+            if (stat((char *)str, &stt) >= 0) {
+                key = uint_hash64(key ^ stt.st_mtim.tv_sec);
+                key = uint_hash64(key ^ stt.st_mtim.tv_nsec);
+            }
+        }
+        FcStrListDone(lists[i]);
+    }
+
+    return key;
+}
+
+static void load_fallback_cache(void) {
+    global.fallback_loaded = true;
+    global.fallback_fd = -1;
+    ht_init(&global.fallback, HASH_INIT_CAP, fallback_cmp);
+
+    if (!gconfig.fallback_disk_cache) return;
+
+    char path[PATH_MAX];
+    int fd = open_cache_file(FALLBACK_CACHE_FILE, path);
+    if (fd < 0) return;
+
+    /* File consists of the header line with the key
+     * followed by lines in the format "<style> <ch> <index> [<file>]",
+     * entries without file are negative */
+    char header[64];
+    snprintf(header, sizeof header, FALLBACK_CACHE_MAGIC" %016"PRIx64"\n", fallback_cache_key());
+
+    struct stat stt;
+    char *data = NULL;
+    size_t size = 0, header_len = strlen(header);
+    if (fstat(fd, &stt) >= 0 && stt.st_size > (off_t)header_len) {
+        size = stt.st_size;
+        data = xalloc(size + 1);
+        if (pread(fd, data, size, 0) != (ssize_t)size)
+            size = 0;
+        data[size] = '\0';
+    }
+
+    if (size < header_len || memcmp(data, header, header_len)) {
+        if (ftruncate(fd, 0) < 0 || write(fd, header, header_len) != (ssize_t)header_len) {
+            warn("Can't initialize font fallback cache '%s': %s", path, strerror(errno));
+            free(data);
+            close(fd);
+            return;
+        }
+        size = 0;
+    }
+
+    size_t count = 0;
+    char *saveptr = NULL;
+    for (char *line = size ? strtok_r(data + header_len, "\n", &saveptr) : NULL;
+         line; line = strtok_r(NULL, "\n", &saveptr)) {
+        uint32_t style, ch;
+        int index, pos = 0;
+        if (sscanf(line, "%"SCNx32" %"SCNx32" %d%n", &style, &ch, &index, &pos) != 3) break;
+        const char *file = line[pos] == ' ' && line[pos + 1] == '/' ? line + pos + 1 : NULL;
+        fallback_insert(ch, style, file, index);
+        count++;
+    }
+
+    if (gconfig.trace_fonts)
+        info("Font fallback cache '%s' has %zu entries", path, count);
+
+    free(data);
+    global.fallback_fd = fd;
+}
+
+static void store_fallback(uint32_t ch, uint32_t style, const char *file, int index) {
+    fallback_insert(ch, style, file, index);
+
+    if (global.fallback_fd < 0) return;
+
+    char buf[PATH_MAX + 64];
+    int len = file ? snprintf(buf, sizeof buf, "%"PRIx32" %"PRIx32" %d %s\n", style, ch, index, file) :
+                     snprintf(buf, sizeof buf, "%"PRIx32" %"PRIx32" -1\n", style, ch);
+    if (len <= 0 || (size_t)len >= sizeof buf || strchr(file ? file : "", '\n')) return;
+
+    if (write(global.fallback_fd, buf, len) != len && gconfig.trace_fonts)
+        warn("Can't write to font fallback cache: %s", strerror(errno));
+}
+
+static void free_fallback_cache(void) {
+    if (!global.fallback_loaded) return;
+
+    ht_iter_t it = ht_begin(&global.fallback);
+    while (ht_current(&it)) {
+        struct fallback_entry *entry = (struct fallback_entry *)ht_erase_current(&it);
+        free(entry->file);
+        free(entry);
+    }
+    ht_free(&global.fallback);
+
+    for (size_t i = 0; i < global.fallback_fonts_count; i++)
+        FcPatternDestroy(global.fallback_fonts[i].pat);
+    free(global.fallback_fonts);
+    global.fallback_fonts = NULL;
+    global.fallback_fonts_count = global.fallback_fonts_caps = 0;
+
+    if (global.fallback_fd >= 0)
+        close(global.fallback_fd);
+    global.fallback_loaded = false;
+}
+
+/* Returns new reference to the pattern of the fallback font for the code point,
+ * NULL if it is not known yet, or if no font covers it (*negative is set then) */
+static FcPattern *lookup_fallback(uint32_t ch, uint32_t style, bool *negative) {
+    struct fallback_entry dummy = mkfallbackkey(ch, style);
+    struct fallback_entry *entry = (struct fallback_entry *)ht_find(&global.fallback, &dummy.head);
+
+    *negative = entry && !entry->file;
+    if (entry && entry->file) {
+        return FcPatternBuild(NULL, FC_FILE, FcTypeString, (FcChar8 *)entry->file,
+                              FC_INDEX, FcTypeInteger, entry->index, (char *)NULL);
+    }
+
+    if (entry) return NULL;
+
+    for (size_t i = 0; i < global.fallback_fonts_count; i++) {
+        struct fallback_font *font = &global.fallback_fonts[i];
+        if (font->style == style && FcCharSetHasChar(font->charset, ch)) {
+            FcValue file, index;
+            if (FcPatternGet(font->pat, FC_FILE, 0, &file) == FcResultMatch &&
+                FcPatternGet(font->pat, FC_INDEX, 0, &index) == FcResultMatch)
+                store_fallback(ch, style, (const char *)file.u.s, index.u.i);
+            FcPatternReference(font->pat);
+            return font->pat;
+        }
+    }
+
+    return NULL;
+}
+
+static void add_fallback_font(FcPattern *pat, uint32_t style, uint32_t ch) {
+    FcCharSet *charset;
+    FcValue file, index;
+    if (FcPatternGet(pat, FC_FILE, 0, &file) != FcResultMatch ||
+        FcPatternGet(pat, FC_INDEX, 0, &index) != FcResultMatch ||
+        FcPatternGetCharSet(pat, FC_CHARSET, 0, &charset) != FcResultMatch) return;
+
+    adjust_buffer((void **)&global.fallback_fonts, &global.fallback_fonts_caps,
+                  global.fallback_fonts_count + 1, sizeof *global.fallback_fonts);
+
+    FcPatternReference(pat);
+    global.fallback_fonts[global.fallback_fonts_count++] = (struct fallback_font) {
+        .style = style,
+        .pat = pat,
+        .charset = charset,
+    };
+
+    store_fallback(ch, style, (const char *)file.u.s, index.u.i);
+}
 
 void free_font(struct font *font) {
     if (--font->refs == 0) {
+        pthread_mutex_lock(&global.lock);
         for (size_t i = 0; i < face_MAX; i++) {
             for (size_t j = 0; j < font->face_types[i].length; j++) {
                 struct face *face = font->face_types[i].faces[j];
@@ -82,9 +367,11 @@ void free_font(struct font *font) {
             ht_free(&font->face_types[i].face_ht);
         }
         if (--global.fonts == 0) {
+            free_fallback_cache();
             FcFini();
             FT_Done_FreeType(global.library);
         }
+        pthread_mutex_unlock(&global.lock);
         free(font);
     }
 }
@@ -290,6 +577,7 @@ static bool face_cmp(const ht_head_t *a, const ht_head_t *b) {
 }
 
 struct font *create_font(const char* descr, double size, double dpi, double gamma, bool force_scalable, bool allow_subst) {
+    pthread_mutex_lock(&global.lock);
     if (global.fonts++ == 0) {
         if (FcInit() == FcFalse)
             die("Can't initialize fontconfig");
@@ -312,8 +600,11 @@ struct font *create_font(const char* descr, double size, double dpi, double gamm
     for (size_t i = 0; i < face_MAX; i++) {
         ht_init(&font->face_types[i].face_ht, HT_INIT_CAPS, face_cmp);
         has_svg |= load_face_list(font, &font->face_types[i], descr, i, size);
+        font->face_types[i].primary = font->face_types[i].length;
     }
 
+    pthread_mutex_unlock(&global.lock);
+
     if (has_svg)
         warn("Font '%s' contains SVG glyphs and might be rendered incorrectly", descr);
 
@@ -329,18 +620,46 @@ struct font *font_ref(struct font *font) {
     return font;
 }
 
+static void load_substitute(struct font *font, struct face_list *faces, FcPattern *pat, int pixsize, uint32_t ch) {
+    bool has_svg = load_append_fonts(font, faces, (struct pattern_holder){ .length = 1, .pats = &pat }, pixsize);
+    if (has_svg)
+        warn("Substitute font for character U+%04x (%lc) contains SVG glyphs and might be rendered incorrectly", ch, ch);
+
+    FcPatternDestroy(pat);
+}
+
 static void add_font_substitute(struct font *font, struct face_list *faces, enum face_name attr, uint32_t ch) {
+    int pixsize = faces->faces[0]->face->size->metrics.x_ppem;
+    bool scalable = font->force_scalable || FT_IS_SCALABLE(faces->faces[0]->face);
+
+    /* Pixel size only affects selection of bitmap fonts */
+    uint32_t style = attr | scalable << 2 | (scalable ? 0 : (uint32_t)pixsize << 3);
+
+    if (!global.fallback_loaded)
+        load_fallback_cache();
+
+    bool negative;
+    FcPattern *cached = lookup_fallback(ch, style, &negative);
+    if (cached) {
+        load_substitute(font, faces, cached, pixsize, ch);
+        return;
+    }
+    if (negative) {
+        if (gconfig.trace_fonts)
+            info("No font covers character U+%04x (cached)", ch);
+        return;
+    }
+
     FcCharSet *subst_chars = FcCharSetCreate();
     FcCharSetAddChar(subst_chars, ch);
 
     FcPattern *chset_pat = FcPatternCreate();
     FcPatternAddDouble(chset_pat, FC_DPI, font->dpi);
-    int pixsize = faces->faces[0]->face->size->metrics.x_ppem;
     FcPatternAddInteger(chset_pat, FC_PIXEL_SIZE, pixsize);
     FcPatternAddCharSet(chset_pat, FC_CHARSET, subst_chars);
     FcCharSetDestroy(subst_chars);
 
-    if (font->force_scalable || FT_IS_SCALABLE(faces->faces[0]->face))
+    if (scalable)
         FcPatternAddBool(chset_pat, FC_SCALABLE, FcTrue);
 
     switch (attr) {
@@ -385,11 +704,18 @@ static void add_font_substitute(struct font *font, struct face_list *faces, enum
         return;
     }
 
-    bool has_svg = load_append_fonts(font, faces, (struct pattern_holder){ .length = 1, .pats = &final_pat }, pixsize);
-    if (has_svg)
-        warn("Substitute font for character U+%04x (%lc) contains SVG glyphs and might be rendered incorrectly", ch, ch);
+    FcCharSet *charset;
+    if (FcPatternGetCharSet(final_pat, FC_CHARSET, 0, &charset) == FcResultMatch &&
+            !FcCharSetHasChar(charset, ch)) {
+        /* Fontconfig returns the best match even if it does not have
+         * the character, remember that so we don't ask again */
+        store_fallback(ch, style, NULL, -1);
+        FcPatternDestroy(final_pat);
+        return;
+    }
 
-    FcPatternDestroy(final_pat);
+    add_fallback_font(final_pat, style, ch);
+    load_substitute(font, faces, final_pat, pixsize, ch);
 }
 
 #define GLYPH_STRIDE_ALIGNMENT 4
@@ -644,10 +970,69 @@ int16_t font_get_size(struct font *font) {
     return font->size;
 }
 
+/* On-disk glyph cache file consists of the header
+ * followed by glyph records, each record is a struct disk_glyph
+ * followed by glyph bitmap. Records are only ever appended,
+ * invalid tail is dropped when the file is opened. */
+
+struct disk_cache_header {
+    char magic[8];
+    uint64_t key;
+};
+
+struct disk_glyph {
+    uint32_t g;
+    uint32_t size;
+    /* Color glyphs are downsampled to this width */
+    uint32_t targ_width;
+    uint16_t width, height;
+    int16_t x, y;
+    int16_t x_off, y_off;
+    int16_t stride;
+    int16_t pixmode;
+};
+
+struct disk_entry {
+    ht_head_t head;
+    uint32_t g;
+    uint32_t targ_width;
+    size_t offset;
+};
+
+struct disk_cache {
+    int fd;
+    /* Records present in the file when it was opened,
+     * glyphs stored later are only visible to other instances */
+    uint8_t *map;
+    size_t map_size;
+    struct disk_entry *entries;
+    hashtable_t index;
+};
+
+/* ASCII glyphs are stored in direct-mapped per face
+ * arrays and are never evicted from the cache */
+#define GLYPH_ASCII_MAX 128
+#define GLYPH_SLOTS_INIT_CAPS 256
+
+struct glyph_slot {
+    uint32_t g;
+    struct glyph *glyph;
+};
+
 struct glyph_cache {
     struct font *font;
-    struct list_head lru_list;
-    size_t lru_size;
+    struct disk_cache *disk;
+    struct glyph *ascii[face_MAX][GLYPH_ASCII_MAX];
+    /* Open addressing table with linear probing
+     * for the rest of glyphs, evicted with CLOCK */
+    struct glyph_slot *slots;
+    size_t slots_caps;
+    size_t slots_count;
+    size_t clock_hand;
+    /* Number of slots waiting for rasterization thread */
+    size_t pending;
+    /* Value of raster.collected when glyphs were last installed */
+    uint64_t rasterized;
     int16_t char_width;
     int16_t char_height;
     int16_t char_depth;
@@ -657,17 +1042,405 @@ struct glyph_cache {
     bool override_boxdraw;
     bool force_aligned;
     enum pixel_mode pixmode;
+#if USE_XRENDER
+    /* Glyph set shared by windows using the cache */
+    uint32_t glyph_set;
+#endif
     size_t refc;
+};
+
+/* Placeholder stored in the cache while the glyph is being rasterized */
+static struct glyph pending_glyph;
+
+struct raster_job {
+    struct list_head link;
+    struct glyph_cache *cache;
+    /* Glyph cache does not own its font */
+    struct font *font;
+    uint32_t ch;
+    enum face_name face;
+    uint32_t targ_width;
+    struct glyph *glyph;
+};
 
-    hashtable_t glyphs;
+/* Rasterization thread, jobs are created and
+ * completed glyphs are installed by the main thread */
+static struct rasterizer {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool started;
+    bool stop;
+    struct list_head queue;
+    struct list_head done;
+    int notify_fd[2];
+    /* Number of glyph_raster_collect() calls, main thread only */
+    uint64_t collected;
+} raster = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .notify_fd = { -1, -1 },
 };
 
-#define mkglyphkey(gl) ((struct glyph){ .head = { .hash = uint_hash32(gl)}, .g = (gl) })
+#define mkdiskkey(gl, tw) ((struct disk_entry){ .head = { .hash = uint_hash32((gl) ^ uint_hash32(tw)) }, .g = (gl), .targ_width = (tw) })
+
+static bool disk_entry_cmp(const ht_head_t *a, const ht_head_t *b) {
+    const struct disk_entry *ea = (const struct disk_entry *)a;
+    const struct disk_entry *eb = (const struct disk_entry *)b;
+    return ea->g == eb->g && ea->targ_width == eb->targ_width;
+}
+
+static inline uint64_t key_mix(uint64_t key, uint64_t value) {
+    return uint_hash64(key ^ value);
+}
+
+static inline uint64_t key_mix_double(uint64_t key, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    return key_mix(key, bits);
+}
+
+/* Key covers everything rendered glyph bitmaps depend upon,
+ * font files are identified by their path, size and modification time.
+ * Substitute fonts are determined by fontconfig state, so the key
+ * covers it instead of the substitutes loaded so far. */
+static uint64_t disk_cache_key(struct glyph_cache *cache) {
+    struct font *font = cache->font;
+    uint64_t key = hash64(DISK_CACHE_MAGIC, sizeof DISK_CACHE_MAGIC - 1);
+
+    /* Faces can be appended by the rasterization thread */
+    pthread_mutex_lock(&global.lock);
+
+    key = key_mix(key, cache->pixmode);
+    key = key_mix(key, cache->force_aligned);
+    key = key_mix(key, font->force_scalable);
+    key = key_mix(key, font->allow_subst_font);
+    key = key_mix_double(key, font->dpi);
+    key = key_mix_double(key, font->size);
+    key = key_mix_double(key, font->pixel_size);
+    key = key_mix_double(key, font->gamma);
+
+    if (font->allow_subst_font)
+        key = key_mix(key, fallback_cache_key());
+
+    for (size_t i = 0; i < face_MAX; i++) {
+        struct face_list *faces = &font->face_types[i];
+        key = key_mix(key, faces->primary);
+        for (size_t j = 0; j < faces->primary; j++) {
+            struct face *face = faces->faces[j];
+            struct stat stt;
+            if (stat(face->file, &stt) < 0) {
+                key = 0;
+                goto done;
+            }
+
+            key = key_mix(key, hash64(face->file, face->len));
+            key = key_mix(key, face->index);
+            key = key_mix(key, face->size);
+            key = key_mix(key, stt.st_size);
+            key = key_mix(key, stt.st_mtim.tv_sec);
+            key = key_mix(key, stt.st_mtim.tv_nsec);
+            if (face->has_transform) {
+                key = key_mix(key, face->transform.xx);
+                key = key_mix(key, face->transform.xy);
+                key = key_mix(key, face->transform.yx);
+                key = key_mix(key, face->transform.yy);
+            }
+        }
+    }
+
+done:
+    pthread_mutex_unlock(&global.lock);
+    return key;
+}
+
+static bool disk_record_valid(struct disk_glyph *rec, size_t offset, size_t file_size) {
+    size_t bpp = rec->pixmode == pixmode_mono ? 1 : 4;
+    return rec->size == (size_t)rec->stride * rec->height &&
+           rec->stride >= 0 && (size_t)rec->stride >= rec->width * bpp &&
+           rec->pixmode >= pixmode_mono && rec->pixmode <= pixmode_bgra &&
+           file_size - offset - sizeof *rec >= rec->size;
+}
+
+/* Returns the end of the last valid record */
+static size_t disk_cache_index(struct disk_cache *disk) {
+    size_t count = 0, offset = sizeof(struct disk_cache_header);
+    struct disk_glyph rec;
+
+    /* First pass validates records and counts them,
+     * the index stops at the first invalid record */
+    while (offset + sizeof rec <= disk->map_size) {
+        memcpy(&rec, disk->map + offset, sizeof rec);
+        if (!disk_record_valid(&rec, offset, disk->map_size)) break;
+        offset += sizeof rec + rec.size;
+        count++;
+    }
+
+    size_t end = offset;
+
+    ht_init(&disk->index, MAX(HASH_INIT_CAP, count), disk_entry_cmp);
+    if (!count) return end;
+
+    disk->entries = xalloc(count * sizeof *disk->entries);
+
+    offset = sizeof(struct disk_cache_header);
+    for (size_t i = 0; i < count; i++) {
+        memcpy(&rec, disk->map + offset, sizeof rec);
+        struct disk_entry *entry = &disk->entries[i];
+        *entry = mkdiskkey(rec.g, rec.targ_width);
+        entry->offset = offset;
+        ht_head_t **h = ht_lookup_ptr(&disk->index, &entry->head);
+        ht_insert_hint(&disk->index, h, &entry->head);
+        offset += sizeof rec + rec.size;
+    }
+
+    return end;
+}
+
+struct cache_file {
+    char *name;
+    off_t size;
+    struct timespec mtime;
+};
+
+static int cache_file_cmp(const void *a, const void *b) {
+    /* Oldest files go first */
+    const struct cache_file *fa = a, *fb = b;
+    if (fa->mtime.tv_sec != fb->mtime.tv_sec)
+        return fa->mtime.tv_sec < fb->mtime.tv_sec ? -1 : 1;
+    return (fa->mtime.tv_nsec > fb->mtime.tv_nsec) - (fa->mtime.tv_nsec < fb->mtime.tv_nsec);
+}
+
+/* Removes least recently used glyph cache files until
+ * all of them fit DISK_CACHE_TOTAL_MAX_SIZE, the file
+ * being opened is kept */
+static void prune_disk_caches(const char *path) {
+    const char *current = strrchr(path, '/') + 1;
+    char *dirpath = strndup(path, current - path);
+    DIR *dir = opendir(dirpath);
+    free(dirpath);
+    if (!dir) return;
+
+    struct cache_file *files = NULL;
+    size_t count = 0, caps = 0;
+    uint64_t total = 0;
+
+    for (struct dirent *ent; (ent = readdir(dir)); ) {
+        size_t len = strlen(ent->d_name), slen = sizeof DISK_CACHE_SUFFIX - 1;
+        if (len <= slen || strcmp(ent->d_name + len - slen, DISK_CACHE_SUFFIX)) continue;
+
+        struct stat stt;
+        if (fstatat(dirfd(dir), ent->d_name, &stt, 0) < 0 || !S_ISREG(stt.st_mode)) continue;
+
+        adjust_buffer((void **)&files, &caps, count + 1, sizeof *files);
+        files[count++] = (struct cache_file) {
+            .name = strdup(ent->d_name),
+            .size = stt.st_size,
+            .mtime = stt.st_mtim,
+        };
+        total += stt.st_size;
+    }
+
+    if (total > DISK_CACHE_TOTAL_MAX_SIZE) {
+        qsort(files, count, sizeof *files, cache_file_cmp);
+        for (size_t i = 0; i < count && total > DISK_CACHE_TOTAL_MAX_SIZE; i++) {
+            if (!strcmp(files[i].name, current)) continue;
+            if (unlinkat(dirfd(dir), files[i].name, 0) < 0) continue;
+            total -= files[i].size;
+            if (gconfig.trace_fonts)
+                info("Removed unused glyph cache '%s'", files[i].name);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+        free(files[i].name);
+    free(files);
+    closedir(dir);
+}
+
+/* The header is written to a temporary file first, which is then
+ * moved into place, so that other instances never see a file
+ * without header or get two headers in a single file */
+static int create_disk_cache_file(const char *path, uint64_t key, bool replace) {
+    char tmp[PATH_MAX];
+    if ((size_t)snprintf(tmp, sizeof tmp, "%s.%d", path, (int)getpid()) >= sizeof tmp) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+
+    struct disk_cache_header hdr = { .key = key };
+    memcpy(hdr.magic, DISK_CACHE_MAGIC, sizeof hdr.magic);
+
+    bool ok = write(fd, &hdr, sizeof hdr) == sizeof hdr &&
+              (replace ? rename(tmp, path) : link(tmp, path)) >= 0;
+    int err = errno;
+
+    if (!replace || !ok) unlink(tmp);
+    if (!ok) {
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    return fd;
+}
+
+static int open_disk_cache_file(const char *path, uint64_t key) {
+    /* Retry once if another instance creates the file concurrently */
+    for (int i = 0; i < 2; i++) {
+        int fd = open(path, O_RDWR | O_APPEND | O_CLOEXEC);
+        if (fd >= 0) {
+            struct disk_cache_header hdr;
+            if (pread(fd, &hdr, sizeof hdr, 0) == sizeof hdr &&
+                !memcmp(hdr.magic, DISK_CACHE_MAGIC, sizeof hdr.magic) && hdr.key == key)
+                return fd;
+
+            /* Corrupted file, start from scratch */
+            close(fd);
+            if ((fd = create_disk_cache_file(path, key, true)) >= 0) return fd;
+            break;
+        }
+
+        if (errno != ENOENT) break;
+        if ((fd = create_disk_cache_file(path, key, false)) >= 0) return fd;
+        if (errno != EEXIST) break;
+    }
 
-static bool glyph_cmp(const ht_head_t *a, const ht_head_t *b) {
-    const struct glyph *ga = (const struct glyph *)a;
-    const struct glyph *gb = (const struct glyph *)b;
-    return ga->g == gb->g;
+    warn("Can't open glyph cache '%s': %s", path, strerror(errno));
+    return -1;
+}
+
+static struct disk_cache *open_disk_cache(struct glyph_cache *cache) {
+    if (!gconfig.glyph_disk_cache) return NULL;
+
+    uint64_t key = disk_cache_key(cache);
+    if (!key) return NULL;
+
+    char name[32], path[PATH_MAX];
+    snprintf(name, sizeof name, "%016"PRIx64 DISK_CACHE_SUFFIX, key);
+
+    if (!cache_file_path(name, path)) return NULL;
+
+    int fd = open_disk_cache_file(path, key);
+    if (fd < 0) return NULL;
+
+    /* Modification time tracks usage for pruning */
+    futimens(fd, NULL);
+    prune_disk_caches(path);
+
+    struct stat stt;
+    if (fstat(fd, &stt) < 0) {
+        warn("Can't stat glyph cache '%s': %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    struct disk_cache *disk = xzalloc(sizeof *disk);
+    disk->fd = fd;
+
+    if (stt.st_size > (off_t)sizeof(struct disk_cache_header)) {
+        void *map = mmap(NULL, stt.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            disk->map = map;
+            disk->map_size = stt.st_size;
+        } else {
+            warn("Can't map glyph cache '%s': %s", path, strerror(errno));
+        }
+    }
+
+    size_t end = disk_cache_index(disk);
+    if (disk->map && end < disk->map_size) {
+        /* Drop the invalid tail, e.g. left by a failed write,
+         * otherwise records appended after it are never loaded */
+        if (ftruncate(fd, end) < 0)
+            warn("Can't truncate glyph cache '%s': %s", path, strerror(errno));
+        else if (gconfig.trace_fonts)
+            info("Dropped %zu bytes of invalid records from glyph cache '%s'", disk->map_size - end, path);
+    }
+
+    if (gconfig.trace_fonts) {
+        info("Glyph cache '%s' has %zd glyphs (%zu bytes)",
+             path, (ssize_t)disk->index.size, (size_t)stt.st_size);
+    }
+
+    return disk;
+}
+
+static void free_disk_cache(struct disk_cache *disk) {
+    if (!disk) return;
+    if (disk->map)
+        munmap(disk->map, disk->map_size);
+    ht_free(&disk->index);
+    free(disk->entries);
+    close(disk->fd);
+    free(disk);
+}
+
+static struct glyph *disk_cache_load(struct disk_cache *disk, uint32_t g, uint32_t targ_width) {
+    if (!disk) return NULL;
+
+    struct disk_entry dummy = mkdiskkey(g, targ_width);
+    ht_head_t *found = ht_find(&disk->index, &dummy.head);
+    if (!found) return NULL;
+
+    struct disk_entry *entry = CONTAINEROF(found, struct disk_entry, head);
+    struct disk_glyph rec;
+    memcpy(&rec, disk->map + entry->offset, sizeof rec);
+
+    struct glyph *glyph = aligned_alloc(_Alignof(struct glyph), ROUNDUP(sizeof(*glyph) + rec.size, _Alignof(struct glyph)));
+    if (!glyph) return NULL;
+
+    glyph->x = rec.x;
+    glyph->y = rec.y;
+    glyph->width = rec.width;
+    glyph->height = rec.height;
+    glyph->x_off = rec.x_off;
+    glyph->y_off = rec.y_off;
+    glyph->stride = rec.stride;
+    glyph->pixmode = rec.pixmode;
+    glyph->id = 0;
+    memcpy(glyph->data, disk->map + entry->offset + sizeof rec, rec.size);
+
+    return glyph;
+}
+
+static void disk_cache_store(struct disk_cache *disk, struct glyph *glyph, uint32_t g, uint32_t targ_width) {
+    if (!disk) return;
+
+    struct disk_glyph rec = {
+        .g = g,
+        .size = (uint32_t)glyph->stride * glyph->height,
+        .targ_width = targ_width,
+        .width = glyph->width,
+        .height = glyph->height,
+        .x = glyph->x,
+        .y = glyph->y,
+        .x_off = glyph->x_off,
+        .y_off = glyph->y_off,
+        .stride = glyph->stride,
+        .pixmode = glyph->pixmode,
+    };
+
+    /* Other instances append to the same file */
+    struct stat stt;
+    if (fstat(disk->fd, &stt) < 0 ||
+        (size_t)stt.st_size + sizeof rec + rec.size > DISK_CACHE_MAX_SIZE) return;
+
+    /* Record is written with a single call to make it atomic with
+     * respect to other instances appending to the same file */
+    size_t size = sizeof rec + rec.size;
+    uint8_t *buf = xalloc(size);
+    memcpy(buf, &rec, sizeof rec);
+    memcpy(buf + sizeof rec, glyph->data, rec.size);
+
+    ssize_t res = write(disk->fd, buf, size);
+    if (res != (ssize_t)size && gconfig.trace_fonts)
+        warn("Can't write glyph to cache: %s", res < 0 ? strerror(errno) : "short write");
+
+    free(buf);
 }
 
 struct glyph_cache *create_glyph_cache(struct font *font, enum pixel_mode pixmode, int16_t vspacing, int16_t hspacing, int16_t underline_width, bool boxdraw, bool force_aligned) {
@@ -681,8 +1454,9 @@ struct glyph_cache *create_glyph_cache(struct font *font, enum pixel_mode pixmod
     cache->override_boxdraw = boxdraw;
     cache->force_aligned = force_aligned;
     cache->pixmode = pixmode;
-    ht_init(&cache->glyphs, HASH_INIT_CAP, glyph_cmp);
-    list_init(&cache->lru_list);
+    cache->slots_caps = GLYPH_SLOTS_INIT_CAPS;
+    cache->slots = xzalloc(cache->slots_caps * sizeof *cache->slots);
+    cache->disk = open_disk_cache(cache);
 
     int16_t total = 0, maxd = 0, maxh = 0;
     for (uint32_t i = ' '; i <= '~'; i++) {
@@ -710,23 +1484,47 @@ struct glyph_cache *glyph_cache_ref(struct glyph_cache *ref) {
     return ref;
 }
 
+bool glyph_cache_is_rasterized(struct glyph_cache *cache) {
+    return cache->rasterized == raster.collected;
+}
+
 void glyph_cache_get_dim(struct glyph_cache *cache, int16_t *w, int16_t *h, int16_t *d) {
     if (w) *w = cache->char_width;
     if (h) *h = cache->char_height;
     if (d) *d = cache->char_depth;
 }
 
+#if USE_XRENDER
+uint32_t glyph_cache_get_glyph_set(struct glyph_cache *cache) {
+    return cache->glyph_set;
+}
+
+void glyph_cache_set_glyph_set(struct glyph_cache *cache, uint32_t gsid) {
+    cache->glyph_set = gsid;
+}
+#endif
+
+static void release_glyph(struct glyph *glyph) {
+    if (!glyph || glyph == &pending_glyph) return;
+#if USE_XRENDER
+    x11_xrender_release_glyph(glyph);
+#endif
+    free(glyph);
+}
+
 void free_glyph_cache(struct glyph_cache *cache) {
     if (!--cache->refc) {
-        ht_iter_t it = ht_begin(&cache->glyphs);
-        while (ht_current(&it)) {
-            ht_head_t *elem = ht_erase_current(&it);
+        for (size_t i = 0; i < face_MAX; i++)
+            for (size_t j = 0; j < GLYPH_ASCII_MAX; j++)
+                release_glyph(cache->ascii[i][j]);
+        for (size_t i = 0; i < cache->slots_caps; i++)
+            release_glyph(cache->slots[i].glyph);
+        free(cache->slots);
+        free_disk_cache(cache->disk);
 #if USE_XRENDER
-            x11_xrender_release_glyph((struct glyph *)elem);
+        if (cache->glyph_set)
+            x11_xrender_release_glyph_set(cache->glyph_set);
 #endif
-            free(elem);
-        }
-        ht_free(&cache->glyphs);
         free(cache);
     }
 }
@@ -787,20 +1585,286 @@ static struct glyph *make_undercurl(int16_t width, int16_t depth, int16_t underl
     return glyph;
 }
 
-/* We don't cache ASCII characters */
-#define LRU_MIN_CACHED 128
+static inline size_t slot_home(struct glyph_cache *cache, uint32_t g) {
+    return uint_hash32(g) & (cache->slots_caps - 1);
+}
 
-struct glyph *glyph_cache_fetch(struct glyph_cache *cache, uint32_t ch, enum face_name face, bool *is_new) {
-    struct glyph dummy = mkglyphkey(ch | (face << 24));
-    ht_head_t **h = ht_lookup_ptr(&cache->glyphs, (ht_head_t *)&dummy);
-    if (*h) {
-        if (is_new) *is_new = false;
-        struct glyph *g = CONTAINEROF(*h, struct glyph, head);
-        if (g->g >= LRU_MIN_CACHED) {
-            list_remove(&g->lru);
-            list_insert_after(&cache->lru_list, &g->lru);
+/* Returns either the slot containing g or the empty slot where it should be inserted */
+static inline struct glyph_slot *find_slot(struct glyph_cache *cache, uint32_t g) {
+    size_t mask = cache->slots_caps - 1;
+    for (size_t i = slot_home(cache, g); ; i = (i + 1) & mask) {
+        struct glyph_slot *slot = &cache->slots[i];
+        if (!slot->glyph || slot->g == g) return slot;
+    }
+}
+
+static void grow_slots(struct glyph_cache *cache) {
+    struct glyph_slot *old = cache->slots;
+    size_t old_caps = cache->slots_caps;
+
+    cache->slots_caps *= 2;
+    cache->slots = xzalloc(cache->slots_caps * sizeof *cache->slots);
+    cache->clock_hand = 0;
+
+    for (size_t i = 0; i < old_caps; i++)
+        if (old[i].glyph) *find_slot(cache, old[i].g) = old[i];
+
+    free(old);
+}
+
+/* Backward shift deletion, keeps probe sequences intact without tombstones */
+static void erase_slot(struct glyph_cache *cache, size_t hole) {
+    size_t mask = cache->slots_caps - 1;
+    cache->slots[hole].glyph = NULL;
+
+    for (size_t i = (hole + 1) & mask; cache->slots[i].glyph; i = (i + 1) & mask) {
+        /* Element can be moved to the hole only if
+         * its home slot is not in (hole, i] cyclically */
+        size_t home = slot_home(cache, cache->slots[i].g);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            cache->slots[hole] = cache->slots[i];
+            cache->slots[i].glyph = NULL;
+            hole = i;
+        }
+    }
+
+    cache->slots_count--;
+}
+
+static void evict_glyph(struct glyph_cache *cache) {
+    size_t mask = cache->slots_caps - 1;
+    for (;;) {
+        size_t hand = cache->clock_hand++ & mask;
+        struct glyph *glyph = cache->slots[hand].glyph;
+        if (!glyph || glyph == &pending_glyph) continue;
+        if (glyph->referenced) {
+            glyph->referenced = false;
+            continue;
+        }
+
+        release_glyph(glyph);
+        erase_slot(cache, hand);
+        /* Backward shift could have moved unvisited glyph here */
+        cache->clock_hand = hand;
+        return;
+    }
+}
+
+static void insert_glyph(struct glyph_cache *cache, uint32_t ch, enum face_name face, struct glyph *glyph) {
+    if (ch < GLYPH_ASCII_MAX) {
+        cache->ascii[face][ch] = glyph;
+        return;
+    }
+
+    uint32_t g = ch | (face << 24);
+    struct glyph_slot *slot = find_slot(cache, g);
+    if (slot->glyph == &pending_glyph) {
+        cache->pending--;
+    } else {
+        while (cache->slots_count - cache->pending >= gconfig.font_cache_size)
+            evict_glyph(cache);
+        if (2*(cache->slots_count + 1) > cache->slots_caps)
+            grow_slots(cache);
+        slot = find_slot(cache, g);
+        cache->slots_count++;
+    }
+
+    if (glyph == &pending_glyph)
+        cache->pending++;
+
+    slot->g = g;
+    slot->glyph = glyph;
+}
+
+static struct glyph *rasterize_glyph(struct glyph_cache *cache, uint32_t ch, enum face_name face, uint32_t targ_width) {
+    pthread_mutex_lock(&global.lock);
+    struct glyph *glyph = font_render_glyph(cache->font, cache->pixmode, ch, face, cache->force_aligned, targ_width);
+    if (glyph) disk_cache_store(cache->disk, glyph, ch | (face << 24), targ_width);
+    pthread_mutex_unlock(&global.lock);
+    return glyph;
+}
+
+static void *raster_worker(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&raster.lock);
+    for (;;) {
+        while (!raster.stop && list_empty(&raster.queue))
+            pthread_cond_wait(&raster.cond, &raster.lock);
+        if (raster.stop) break;
+
+        struct raster_job *job = CONTAINEROF(list_remove(raster.queue.next), struct raster_job, link);
+        pthread_mutex_unlock(&raster.lock);
+
+        job->glyph = rasterize_glyph(job->cache, job->ch, job->face, job->targ_width);
+
+        pthread_mutex_lock(&raster.lock);
+        bool need_notify = list_empty(&raster.done);
+        list_insert_before(&raster.done, &job->link);
+        if (need_notify && write(raster.notify_fd[1], "", 1) < 0 && errno != EAGAIN)
+            warn("Can't notify about rasterized glyphs: %s", strerror(errno));
+    }
+    pthread_mutex_unlock(&raster.lock);
+
+    return NULL;
+}
+
+static bool start_raster_worker(void) {
+    /* Signals should only be handled by the main thread */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int res = pthread_create(&raster.thread, NULL, raster_worker, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (res) {
+        warn("Can't start rasterization thread: %s", strerror(res));
+        return false;
+    }
+
+    raster.started = true;
+    return true;
+}
+
+static bool enqueue_glyph(struct glyph_cache *cache, uint32_t ch, enum face_name face, uint32_t targ_width) {
+    if (raster.notify_fd[0] < 0) return false;
+    if (!raster.started && !start_raster_worker()) return false;
+
+    struct raster_job *job = xalloc(sizeof *job);
+    *job = (struct raster_job) {
+        .cache = glyph_cache_ref(cache),
+        .font = font_ref(cache->font),
+        .ch = ch,
+        .face = face,
+        .targ_width = targ_width,
+    };
+
+    pthread_mutex_lock(&raster.lock);
+    list_insert_before(&raster.queue, &job->link);
+    pthread_cond_signal(&raster.cond);
+    pthread_mutex_unlock(&raster.lock);
+
+    insert_glyph(cache, ch, face, &pending_glyph);
+    return true;
+}
+
+static void free_raster_job(struct raster_job *job) {
+    free_glyph_cache(job->cache);
+    free_font(job->font);
+    free(job);
+}
+
+int glyph_raster_init(void) {
+    int fds[2];
+    if (pipe(fds) < 0) {
+        warn("Can't create pipe: %s", strerror(errno));
+        return -1;
+    }
+
+    if (set_cloexec(fds[0]) < 0 || set_nonblocking(fds[0]) < 0 ||
+        set_cloexec(fds[1]) < 0 || set_nonblocking(fds[1]) < 0) {
+        warn("Can't set pipe flags: %s", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    list_init(&raster.queue);
+    list_init(&raster.done);
+    raster.notify_fd[0] = fds[0];
+    raster.notify_fd[1] = fds[1];
+    return fds[0];
+}
+
+void glyph_raster_free(void) {
+    if (raster.notify_fd[0] < 0) return;
+
+    if (raster.started) {
+        pthread_mutex_lock(&raster.lock);
+        raster.stop = true;
+        pthread_cond_signal(&raster.cond);
+        pthread_mutex_unlock(&raster.lock);
+        pthread_join(raster.thread, NULL);
+        raster.started = false;
+    }
+
+    if (!list_empty(&raster.queue)) {
+        list_insert_range_before(&raster.done, raster.queue.next, raster.queue.prev);
+        list_init(&raster.queue);
+    }
+    LIST_FOREACH_SAFE(it, &raster.done) {
+        struct raster_job *job = CONTAINEROF(list_remove(it), struct raster_job, link);
+        release_glyph(job->glyph);
+        free_raster_job(job);
+    }
+
+    close(raster.notify_fd[0]);
+    close(raster.notify_fd[1]);
+    raster.notify_fd[0] = raster.notify_fd[1] = -1;
+}
+
+bool glyph_raster_collect(void) {
+    char buf[64];
+    while (read(raster.notify_fd[0], buf, sizeof buf) > 0);
+
+    struct list_head done;
+    list_init(&done);
+
+    pthread_mutex_lock(&raster.lock);
+    if (!list_empty(&raster.done)) {
+        list_insert_range_after(&done, raster.done.next, raster.done.prev);
+        list_init(&raster.done);
+    }
+    pthread_mutex_unlock(&raster.lock);
+
+    bool installed = false;
+    raster.collected++;
+    LIST_FOREACH_SAFE(it, &done) {
+        struct raster_job *job = CONTAINEROF(list_remove(it), struct raster_job, link);
+        struct glyph_cache *cache = job->cache;
+        uint32_t g = job->ch | (job->face << 24);
+
+        struct glyph_slot *slot = job->ch < GLYPH_ASCII_MAX ? NULL : find_slot(cache, g);
+        struct glyph *current = slot ? slot->glyph : cache->ascii[job->face][job->ch];
+
+        if (current != &pending_glyph) {
+            /* Glyph was rendered synchronously in the meantime */
+            release_glyph(job->glyph);
+        } else if (job->glyph) {
+            job->glyph->g = g;
+            job->glyph->referenced = true;
+            job->glyph->unseen = true;
+            insert_glyph(cache, job->ch, job->face, job->glyph);
+            cache->rasterized = raster.collected;
+            installed = true;
+        } else if (slot) {
+            /* Failed glyphs are retried on the next redraw */
+            erase_slot(cache, slot - cache->slots);
+            cache->pending--;
+            cache->rasterized = raster.collected;
+            installed = true;
+        } else {
+            cache->ascii[job->face][job->ch] = NULL;
+            cache->rasterized = raster.collected;
+            installed = true;
         }
-        return g;
+
+        free_raster_job(job);
+    }
+
+    return installed;
+}
+
+static struct glyph *fetch_glyph(struct glyph_cache *cache, uint32_t ch, enum face_name face, bool *is_new, bool *pending) {
+    uint32_t g = ch | (face << 24);
+    struct glyph *glyph = ch < GLYPH_ASCII_MAX ? cache->ascii[face][ch] : find_slot(cache, g)->glyph;
+
+    if (glyph && glyph != &pending_glyph) {
+        /* Glyphs rasterized asynchronously are reported as new when first fetched */
+        if (is_new) *is_new = glyph->unseen;
+        glyph->unseen = false;
+        glyph->referenced = true;
+        return glyph;
     }
 
     if (is_new) *is_new = true;
@@ -815,30 +1879,48 @@ struct glyph *glyph_cache_fetch(struct glyph_cache *cache, uint32_t ch, enum fac
     if (ch == GLYPH_UNDERCURL)
         new = make_undercurl(cache->char_width, cache->char_depth, cache->underline_width,
                              cache->pixmode, cache->hspacing, cache->force_aligned);
-    else
-        new = font_render_glyph(cache->font, cache->pixmode, ch, face, cache->force_aligned, cache->char_width*2);
+    else {
+        uint32_t targ_width = cache->char_width*2;
+        new = disk_cache_load(cache->disk, g, targ_width);
+        if (!new && pending && (glyph == &pending_glyph || enqueue_glyph(cache, ch, face, targ_width))) {
+            if (is_new) *is_new = !glyph;
+            *pending = true;
+            return NULL;
+        }
+        if (!new)
+            new = rasterize_glyph(cache, ch, face, targ_width);
+    }
     if (!new) return NULL;
 
-    new->g = dummy.g;
-    new->head = dummy.head;
+    new->g = g;
+    new->referenced = true;
+    new->unseen = false;
 
-    ht_insert_hint(&cache->glyphs, h, &new->head);
+    insert_glyph(cache, ch, face, new);
+    return new;
+}
 
-    if (dummy.g >= LRU_MIN_CACHED) {
-        if (cache->lru_size >= gconfig.font_cache_size) {
-            struct glyph *old = CONTAINEROF(cache->lru_list.prev, struct glyph, lru);
-            assert(old != new);
-            list_remove(&old->lru);
-#if USE_XRENDER
-            x11_xrender_release_glyph(old);
-#endif
-            ht_erase(&cache->glyphs, &old->head);
-            free(old);
-        } else {
-            cache->lru_size++;
-        }
-        list_insert_after(&cache->lru_list, &new->lru);
-    }
+struct glyph *glyph_cache_fetch(struct glyph_cache *cache, uint32_t ch, enum face_name face, bool *is_new) {
+    return fetch_glyph(cache, ch, face, is_new, NULL);
+}
 
-    return new;
+struct glyph *glyph_cache_fetch_async(struct glyph_cache *cache, uint32_t ch, enum face_name face, bool *is_new, bool *pending) {
+    *pending = false;
+    return fetch_glyph(cache, ch, face, is_new, pending);
+}
+
+bool glyph_cache_prewarm(struct glyph_cache *cache, uint32_t ch, enum face_name face) {
+    uint32_t g = ch | (face << 24);
+    if (ch < GLYPH_ASCII_MAX ? cache->ascii[face][ch] : find_slot(cache, g)->glyph) return true;
+
+    /* Glyphs that were never used should not evict ones that were */
+    if (ch >= GLYPH_ASCII_MAX && 2*(cache->slots_count + 1) > gconfig.font_cache_size) return false;
+
+    struct glyph *glyph = fetch_glyph(cache, ch, face, NULL, NULL);
+    if (glyph) {
+        /* Renderers should see it as new when it is fetched for the first time */
+        glyph->unseen = true;
+        glyph->referenced = false;
+    }
+    return true;
 }
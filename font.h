@@ -1,4 +1,4 @@
-/* Copyright (c) 2019-2022,2025, Evgeniy Baskov. All rights reserved */
+/* Copyright (c) 2019-2022,2025-2026, Evgeniy Baskov. All rights reserved */
 
 #ifndef FONT_H_
 #define FONT_H_ 1
@@ -35,9 +35,6 @@ enum pixel_mode {
 #define GLYPH_ALIGNMENT MAX(16, MALLOC_ALIGNMENT)
 
 struct glyph {
-    ht_head_t head;
-    struct list_head lru;
-
 #ifdef USE_XRENDER
     uint32_t id;
 #endif
@@ -49,6 +46,10 @@ struct glyph {
     int16_t stride;
 
     int16_t pixmode;
+    /* CLOCK reference bit, set on cache hits */
+    bool referenced;
+    /* Set for asynchronously rasterized glyphs until first fetched */
+    bool unseen;
     _Alignas(GLYPH_ALIGNMENT) uint8_t data[];
 };
 
@@ -63,6 +64,24 @@ struct glyph_cache *create_glyph_cache(struct font *font, enum pixel_mode pixmod
 struct glyph_cache *glyph_cache_ref(struct glyph_cache *ref);
 void free_glyph_cache(struct glyph_cache *cache);
 void glyph_cache_get_dim(struct glyph_cache *cache, int16_t *w, int16_t *h, int16_t *d);
+#if USE_XRENDER
+/* XRender glyph set is owned by the cache and freed with it */
+uint32_t glyph_cache_get_glyph_set(struct glyph_cache *cache);
+void glyph_cache_set_glyph_set(struct glyph_cache *cache, uint32_t gsid);
+#endif
 struct glyph *glyph_cache_fetch(struct glyph_cache *cache, uint32_t ch, enum face_name face, bool *is_new);
+/* Same as glyph_cache_fetch(), but glyphs that need to be rasterized are queued
+ * to the rasterization thread if it is enabled, NULL is returned and *pending is set */
+struct glyph *glyph_cache_fetch_async(struct glyph_cache *cache, uint32_t ch, enum face_name face, bool *is_new, bool *pending);
+/* Rasterizes glyph ahead of time unless it is already cached,
+ * returns false if the cache has no room left for such glyphs */
+bool glyph_cache_prewarm(struct glyph_cache *cache, uint32_t ch, enum face_name face);
+/* Returns file descriptor that becomes readable when glyphs are rasterized */
+int glyph_raster_init(void);
+void glyph_raster_free(void);
+/* Installs rasterized glyphs into caches, returns true if there were any */
+bool glyph_raster_collect(void);
+/* Returns true if the last glyph_raster_collect() installed glyphs into the cache */
+bool glyph_cache_is_rasterized(struct glyph_cache *cache);
 
 #endif
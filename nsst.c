@@ -175,17 +175,24 @@ int main(int argc, char **argv) {
     init_proto_tree();
     atexit(uri_release_memory);
 #endif
+    /* Daemon shards are forked before anything else is initialized */
+    if (gconfig.daemon_mode && !init_daemon())
+        return EXIT_FAILURE;
+
     init_poller();
     atexit(free_poller);
 
-    init_context(&global_instance_config);
-    atexit(free_context);
+    /* Dispatcher process of a sharded daemon does not have windows */
+    if (!daemon_is_dispatcher()) {
+        init_context(&global_instance_config);
+        atexit(free_context);
+    }
 
     init_default_termios();
 
     if (gconfig.daemon_mode) {
         atexit(free_daemon);
-        result = !init_daemon();
+        result = !start_daemon();
     } else {
         result = !create_window(&global_instance_config);
     }
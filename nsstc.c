@@ -1,4 +1,4 @@
-/* Copyright (c) 2019-2022, Evgeniy Baskov. All rights reserved */
+/* Copyright (c) 2019-2022,2026, Evgeniy Baskov. All rights reserved */
 
 #include "feature.h"
 
@@ -8,12 +8,14 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/un.h>
@@ -24,6 +26,8 @@
 #define MAX_OPTION_DESC 1024
 #define MAX_WAIT_LOOP 32
 #define STARTUP_DELAY 10000000LL
+/* Maximal time to wait for the window to be created */
+#define ACK_TIMEOUT 10
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 #define WARN_PREFIX "[\033[33;1mWARN\033[m] "
 
@@ -31,9 +35,16 @@ static char buffer[MAX(MAX_OPTION_DESC, PATH_MAX) + 1];
 static const char *config_path;
 static const char *socket_path = "/tmp/nsst-sock0";
 static const char *cwd;
+static const char *attach_id;
 static bool need_daemon;
 static bool need_exit;
 
+/* Whole launch request is sent in a single message,
+ * see handle_batched_launch() in daemon.c */
+static char *batch;
+static size_t batch_size;
+static size_t batch_caps;
+
 static inline void send_char(int fd, char c) {
     while (send(fd, (char[1]){c}, 1, 0) < 0 && errno == EAGAIN);
 }
@@ -63,7 +74,100 @@ static _Noreturn void version(int fd) {
     exit(0);
 }
 
-static void send_opt(int fd, const char *opt, const char *value) {
+static _Noreturn void stats(int fd) {
+    send_char(fd, '\022' /* DC2 */);
+
+    recv_response(fd);
+
+    exit(0);
+}
+
+static _Noreturn void list(int fd) {
+    send_char(fd, '\024' /* DC4 */);
+
+    recv_response(fd);
+
+    exit(0);
+}
+
+static void append_record(struct iovec *dvec, size_t count) {
+    uint32_t len = 0;
+    for (size_t i = 0; i < count; i++)
+        len += dvec[i].iov_len;
+
+    size_t new_size = batch_size + sizeof len + len + 1;
+    if (new_size > batch_caps) {
+        batch_caps = MAX(new_size, 2*batch_caps);
+        if (!(batch = realloc(batch, batch_caps))) {
+            perror("realloc()");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memcpy(batch + batch_size, &len, sizeof len);
+    batch_size += sizeof len;
+    for (size_t i = 0; i < count; i++) {
+        memcpy(batch + batch_size, dvec[i].iov_base, dvec[i].iov_len);
+        batch_size += dvec[i].iov_len;
+    }
+    batch[batch_size++] = '\0';
+}
+
+static void send_batch(int fd) {
+    struct iovec dvec[2] = {
+        { .iov_base = (char *)"\002" /* STX */, .iov_len = 1 },
+        { .iov_base = batch, .iov_len = batch_size },
+    };
+
+    struct msghdr hdr = {
+        .msg_iov = dvec,
+        .msg_iovlen = sizeof dvec / sizeof *dvec
+    };
+
+    while (sendmsg(fd, &hdr, 0) < 0) {
+        if (errno != EAGAIN) {
+            perror("sendmsg()");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/* Returns exit code */
+static int recv_ack(int fd) {
+    struct timeval tv = { .tv_sec = ACK_TIMEOUT };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+
+    ssize_t res = recv(fd, buffer, sizeof buffer - 1, 0);
+    if (res <= 0) {
+        /* Daemon is too old to support batched requests or is stuck */
+        fputs(WARN_PREFIX"No acknowledgment from daemon\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    return buffer[0] == '\006' /* ACK */ ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static _Noreturn void attach(int fd, const char *id) {
+    size_t len = strlen(id);
+    if (len + 2 > sizeof buffer) {
+        fprintf(stderr, "Window ID is too long\n");
+        exit(EXIT_FAILURE);
+    }
+
+    buffer[0] = '\023' /* DC3 */;
+    memcpy(buffer + 1, id, len);
+
+    while (send(fd, buffer, len + 1, 0) < 0) {
+        if (errno != EAGAIN) {
+            perror("send()");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    exit(recv_ack(fd));
+}
+
+static void send_opt(const char *opt, const char *value) {
     /* This API lacks const's but doesn't change values... */
     struct iovec dvec[4] = {
         { .iov_base = (char *)"\035" /* GS */, .iov_len = 1 },
@@ -72,15 +176,10 @@ static void send_opt(int fd, const char *opt, const char *value) {
         { .iov_base = (char *)value, .iov_len = strlen(value) },
     };
 
-    struct msghdr hdr = {
-        .msg_iov = dvec,
-        .msg_iovlen = sizeof dvec / sizeof *dvec
-    };
-
-    while (sendmsg(fd, &hdr, 0) < 0 && errno == EAGAIN);
+    append_record(dvec, sizeof dvec / sizeof *dvec);
 }
 
-static void send_short_opt(int fd, char opt, const char *value) {
+static void send_short_opt(char opt, const char *value) {
     struct iovec dvec[4] = {
         { .iov_base = (char *)"\034" /* FS */, .iov_len = 1 },
         { .iov_base = &opt, .iov_len = 1 },
@@ -88,40 +187,25 @@ static void send_short_opt(int fd, char opt, const char *value) {
         { .iov_base = (char *)value, .iov_len = strlen(value) },
     };
 
-    struct msghdr hdr = {
-        .msg_iov = dvec,
-        .msg_iovlen = sizeof dvec / sizeof *dvec
-    };
-
-    while (sendmsg(fd, &hdr, 0) < 0 && errno == EAGAIN);
+    append_record(dvec, sizeof dvec / sizeof *dvec);
 }
 
-static void send_arg(int fd, char *arg) {
-    struct iovec dvec[4] = {
+static void send_arg(char *arg) {
+    struct iovec dvec[2] = {
         { .iov_base = (char *)"\036" /* RS */, .iov_len = 1 },
         { .iov_base = arg, .iov_len = strlen(arg) },
     };
 
-    struct msghdr hdr = {
-        .msg_iov = dvec,
-        .msg_iovlen = sizeof dvec / sizeof *dvec
-    };
-
-    while (sendmsg(fd, &hdr, 0) < 0 && errno == EAGAIN);
+    append_record(dvec, sizeof dvec / sizeof *dvec);
 }
 
-static void send_header(int fd, const char *cpath) {
-    struct iovec dvec[4] = {
+static void send_header(const char *cpath) {
+    struct iovec dvec[2] = {
         { .iov_base = (char *)"\001" /* SOH */, .iov_len = 1 },
         { .iov_base = (char *)cpath, .iov_len = cpath ? strlen(cpath) : 0 },
     };
 
-    struct msghdr hdr = {
-        .msg_iov = dvec,
-        .msg_iovlen = 1 + !!cpath,
-    };
-
-    while (sendmsg(fd, &hdr, 0) < 0 && errno == EAGAIN);
+    append_record(dvec, 1 + !!cpath);
 }
 
 static bool is_boolean_option(const char *opt) {
@@ -129,15 +213,17 @@ static bool is_boolean_option(const char *opt) {
     const char *bool_opts[] = {
         "allow-alternate", "allow-blinking", "allow-modify-edit-keypad", "allow-modify-function",
         "allow-modify-keypad", "allow-modify-misc", "allow-uris", "alternate-scroll", "appcursor",
-        "appkey", "autorepeat", "autowrap", "backspace-is-del", "blend-all-background",
-        "blend-foreground", "clone-config", "daemon", "delete-is-del", "erase-scrollback", "extended-cir",
-        "fixed", "force-nrcs", "force-scalable", "force-wayland-csd", "fork", "has-meta",
+        "appkey", "async-rasterization", "autorepeat", "autowrap", "backspace-is-del", "blend-all-background",
+        "blend-foreground", "clone-config", "daemon", "delete-is-del", "detach-on-close", "double-buffer",
+        "erase-scrollback", "extended-cir", "fallback-disk-cache", "fixed", "force-nrcs", "force-scalable",
+        "force-wayland-csd", "fork", "glyph-disk-cache", "has-meta",
         "keep-clipboard", "keep-selection", "lock-keyboard", "luit", "meta-sends-escape", "nrcs",
         "numlock", "override-boxdrawing", "print-attributes", "raise-on-bell", "reverse-video",
         "scroll-on-input", "scroll-on-output", "select-to-clipboard", "smooth-resize", "smooth-scroll",
         "special-blink", "special-bold", "special-italic", "special-reverse", "special-underlined",
         "substitute-fonts", "trace-characters", "trace-controls", "trace-events", "trace-fonts",
-        "trace-input", "trace-misc", "unique-uris", "urgent-on-bell", "use-utf8", "visual-bell",
+        "trace-input", "trace-latency", "trace-misc", "unique-uris", "urgent-on-bell", "use-utf8",
+        "visual-bell", "vsync",
         "window-ops",
     };
     for (size_t i = 0; i < sizeof bool_opts/sizeof *bool_opts; i++)
@@ -154,6 +240,7 @@ static inline bool is_client_only_option(const char *opt) {
     if (!strcmp(opt, "socket")) return true;
     if (!strcmp(opt, "cwd")) return true;
     if (!strcmp(opt, "exit")) return true;
+    if (!strcmp(opt, "attach")) return true;
     return false;
 }
 
@@ -193,6 +280,14 @@ static void parse_args(char **argv, int fd, bool client) {
                 if (client) continue;
                 version(fd);
             }
+            if (!strcmp(name, "stats")) {
+                if (client) continue;
+                stats(fd);
+            }
+            if (!strcmp(name, "list")) {
+                if (client) continue;
+                list(fd);
+            }
 
             /* Options with arguments */
             if ((arg = name_end = strchr(name, '=')))
@@ -212,7 +307,7 @@ static void parse_args(char **argv, int fd, bool client) {
                 if (!arg)
                     usage(fd, argv[0], EXIT_FAILURE);
                 if (!is_client_only_option(name))
-                    send_opt(fd, name, arg);
+                    send_opt(name, arg);
             } else {
                 if (!arg) continue;
                 if (!strcmp(name, "config"))
@@ -225,6 +320,8 @@ static void parse_args(char **argv, int fd, bool client) {
                     need_daemon = is_true(arg);
                 else if (!strcmp(name, "quit"))
                     need_exit = is_true(arg);
+                else if (!strcmp(name, "attach"))
+                    attach_id = arg;
             }
 
             /* We need to restore the original
@@ -265,7 +362,7 @@ static void parse_args(char **argv, int fd, bool client) {
             }
 
             if (!client && !is_client_only_short_option(letter))
-                send_short_opt(fd, letter, arg);
+                send_short_opt(letter, arg);
             else if (client) {
                 switch (letter) {
                 case 'q':
@@ -294,7 +391,7 @@ finish:
             if (!argv[arg_i])
                 usage(fd, argv[0], EXIT_FAILURE);
             while (argv[arg_i])
-                send_arg(fd, argv[arg_i++]);
+                send_arg(argv[arg_i++]);
         }
     }
 
@@ -370,12 +467,16 @@ int main(int argc, char **argv) {
         return 0;
     }
 
-    send_header(fd, config_path);
-    if (cwd) send_opt(fd, "cwd", cwd);
+    if (attach_id)
+        attach(fd, attach_id);
+
+    send_header(config_path);
+    if (cwd) send_opt("cwd", cwd);
 
     parse_args(argv, fd, false);
 
-    send_char(fd, '\003' /* ETX */);
+    append_record(&(struct iovec) { .iov_base = (char *)"\003" /* ETX */, .iov_len = 1 }, 1);
+    send_batch(fd);
 
-    return 0;
+    return recv_ack(fd);
 }
@@ -24,11 +24,48 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#if USE_EPOLL
+#   include <sys/epoll.h>
+#endif
+#if USE_IO_URING
+#   include <linux/io_uring.h>
+#   include <sys/mman.h>
+#   include <sys/syscall.h>
+#endif
 
 #define INIT_PFD_NUM 16
 #define INIT_HEAP_NUM 64
 #define EVENT_FREE_MAX 128
 #define FREE_SLOT INT_MIN
+#define URING_ENTRIES 256
+
+#if USE_EPOLL
+/* Poll masks are passed to callbacks as is, so they need to match */
+static_assert(EPOLLIN == POLLIN && EPOLLOUT == POLLOUT && EPOLLPRI == POLLPRI &&
+              EPOLLERR == POLLERR && EPOLLHUP == POLLHUP, "Incompatible epoll masks");
+#endif
+
+#if USE_IO_URING
+struct uring {
+    int fd;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_array;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_size;
+    size_t cq_size;
+    size_t sqes_size;
+};
+#endif
 
 struct event {
     enum event_state {
@@ -38,6 +75,8 @@ struct event {
     } state;
     enum event_flags {
         evt_flag_disabled = (1 << 0),
+        /* There is a pending io_uring poll request for the fd */
+        evt_flag_armed = (1 << 1),
     } flags;
     struct event **pptr;
     union {
@@ -49,10 +88,15 @@ struct event {
             poller_timer_cb_t cb;
             void *arg;
             int64_t period;
+            /* Timers with the same slack are aligned
+             * to the same grid so that they fire together */
+            int64_t slack;
             struct timespec current;
         } timer;
         struct {
             int index;
+            /* Generation of the slot, used to filter out stale epoll events */
+            uint32_t seq;
             poller_fd_cb_t cb;
             void *arg;
         } fd;
@@ -65,6 +109,19 @@ struct poller {
     ssize_t pollfd_array_caps;
     ssize_t pollfd_first_free;
 
+#if USE_EPOLL
+    /* If epoll is not available at runtime,
+     * this is -1 and poll() is used instead */
+    int epoll_fd;
+    struct epoll_event *epoll_events;
+#endif
+#if USE_IO_URING
+    /* If io_uring is not available at runtime,
+     * ring.fd is -1 and epoll or poll() is used instead */
+    struct uring ring;
+#endif
+    uint32_t fd_seq;
+
     struct event *current_event;
     bool delete_current;
     struct event **timer_heap;
@@ -88,9 +145,160 @@ static void empty_tick(void *arg) {
     (void)arg;
 }
 
+#if USE_EPOLL
+static void init_epoll(void) {
+    /* epoll scales better with many windows in daemon mode,
+     * since the kernel does not need to rescan every fd on each wakeup.
+     * The descriptor is CLOEXEC since we fork children. */
+    poller.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (poller.epoll_fd < 0)
+        warn("Can't create epoll instance, falling back to poll(): %s", strerror(errno));
+    else
+        poller.epoll_events = xzalloc(INIT_PFD_NUM * sizeof(*poller.epoll_events));
+}
+#endif
+
+#if USE_IO_URING
+static void free_uring(void) {
+    struct uring *ring = &poller.ring;
+    if (ring->sqes && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ptr && ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_size);
+    if (ring->sq_ptr && ring->sq_ptr != MAP_FAILED)
+        munmap(ring->sq_ptr, ring->sq_size);
+    if (ring->fd >= 0)
+        close(ring->fd);
+    memset(ring, 0, sizeof *ring);
+    ring->fd = -1;
+}
+
+static bool init_uring(void) {
+    struct uring *ring = &poller.ring;
+    struct io_uring_params params = {0};
+
+    /* The ring descriptor is always CLOEXEC */
+    ring->fd = syscall(SYS_io_uring_setup, URING_ENTRIES, &params);
+    if (ring->fd < 0) return false;
+
+    /* Timeouts are passed directly to io_uring_enter(),
+     * which is only supported since Linux 5.11 */
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        free_uring();
+        errno = ENOSYS;
+        return false;
+    }
+
+    ring->sq_size = params.sq_off.array + params.sq_entries*sizeof(uint32_t);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        ring->sq_size = ring->cq_size = MAX(ring->sq_size, ring->cq_size);
+    ring->sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) goto error;
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) goto error;
+    }
+
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) goto error;
+
+    uint8_t *sq = ring->sq_ptr, *cq = ring->cq_ptr;
+    ring->sq_head = (uint32_t *)(sq + params.sq_off.head);
+    ring->sq_tail = (uint32_t *)(sq + params.sq_off.tail);
+    ring->sq_array = (uint32_t *)(sq + params.sq_off.array);
+    ring->sq_mask = *(uint32_t *)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (uint32_t *)(cq + params.cq_off.head);
+    ring->cq_tail = (uint32_t *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(uint32_t *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return true;
+
+error:
+    free_uring();
+    return false;
+}
+
+static int uring_enter(uint32_t min_complete, struct timespec *timeout) {
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg = {0};
+    uint32_t flags = 0;
+
+    if (min_complete) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeout) {
+            ts = (struct __kernel_timespec) { .tv_sec = timeout->tv_sec, .tv_nsec = timeout->tv_nsec };
+            arg.ts = (uintptr_t)&ts;
+        }
+    }
+
+    /* Submit everything queued so far */
+    uint32_t to_submit = *poller.ring.sq_tail - __atomic_load_n(poller.ring.sq_head, __ATOMIC_ACQUIRE);
+    return syscall(SYS_io_uring_enter, poller.ring.fd, to_submit, min_complete,
+                   flags, min_complete ? &arg : NULL, sizeof arg);
+}
+
+static struct io_uring_sqe *uring_get_sqe(void) {
+    struct uring *ring = &poller.ring;
+    uint32_t tail = *ring->sq_tail;
+
+    /* Submission queue is full, submit everything queued so far */
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+        if (uring_enter(0, NULL) < 0)
+            warn("io_uring submission error: %s", strerror(errno));
+        if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries)
+            die("io_uring submission queue overflow");
+    }
+
+    struct io_uring_sqe *sqe = &ring->sqes[tail & ring->sq_mask];
+    memset(sqe, 0, sizeof *sqe);
+    ring->sq_array[tail & ring->sq_mask] = tail & ring->sq_mask;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+static inline uint64_t fd_user_data(struct event *evt) {
+    return (uint64_t)evt->fd.seq << 32 | (uint32_t)evt->fd.index;
+}
+
+/* One-shot poll requests are used since they check the state of the fd
+ * when armed, which gives the same level-triggered semantics as poll().
+ * Requests are re-armed after each callback. */
+static void uring_arm(struct event *evt) {
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    evt->fd.seq = poller.fd_seq++;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = poller.pollfd_array[evt->fd.index].fd;
+    sqe->poll32_events = (uint16_t)poller.pollfd_array[evt->fd.index].events;
+    sqe->user_data = fd_user_data(evt);
+    evt->flags |= evt_flag_armed;
+}
+
+static void uring_disarm(struct event *evt) {
+    if (!(evt->flags & evt_flag_armed)) return;
+
+    /* Completion of the cancelled request is filtered out by sequence number */
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = fd_user_data(evt);
+    sqe->user_data = UINT64_MAX;
+    evt->flags &= ~evt_flag_armed;
+}
+#endif
+
 void init_poller(void) {
-    /* Initialize fd event array. For now it just uses poll, later we can support to
-     * epoll or event io_uring where available. */
+    /* Initialize fd event array. It is used directly by poll() and
+     * as a bookkeeping storage for the epoll and io_uring backends. */
     poller.pollfd_array = xzalloc(INIT_PFD_NUM * sizeof(*poller.pollfd_array));
     poller.pollfd_array_events = xzalloc(INIT_PFD_NUM * sizeof(*poller.pollfd_array_events));
     poller.pollfd_array_caps = INIT_PFD_NUM;
@@ -104,6 +312,25 @@ void init_poller(void) {
     }
     poller.pollfd_array[INIT_PFD_NUM-1].events = -1;
 
+#if USE_IO_URING
+    /* io_uring allows submitting all poll requests
+     * and waiting for events in a single syscall. */
+    if (!init_uring())
+        warn("Can't use io_uring, falling back to %s: %s",
+             USE_EPOLL && gconfig.daemon_mode ? "epoll" : "poll()", strerror(errno));
+#endif
+#if USE_EPOLL
+    poller.epoll_fd = -1;
+    /* epoll only pays off with many windows, a single window
+     * is better off with ppoll() since it has nanosecond timeouts,
+     * while epoll_wait() timeouts are rounded up to milliseconds */
+    if (gconfig.daemon_mode
+#if USE_IO_URING
+        && poller.ring.fd < 0
+#endif
+        ) init_epoll();
+#endif
+
     /* Initialize timer heap. It is maintained in userspace to allow
      * high frequency timer changes. */
 
@@ -116,6 +343,9 @@ void init_poller(void) {
 
     poller.event_free_max = EVENT_FREE_MAX;
     poller.tick_cb = empty_tick;
+
+    /* Timers can be added before the main loop is started */
+    clock_gettime(CLOCK_TYPE, &poller.now);
 }
 
 void poller_add_tick(poller_tick_cb_t tick, void *arg) {
@@ -130,6 +360,16 @@ void free_poller(void) {
     free(poller.pollfd_array_events);
     free(poller.timer_heap);
 
+#if USE_IO_URING
+    if (poller.ring.fd >= 0)
+        free_uring();
+#endif
+#if USE_EPOLL
+    if (poller.epoll_fd >= 0)
+        close(poller.epoll_fd);
+    free(poller.epoll_events);
+#endif
+
     while (poller.event_free_list) {
         struct event *evt = poller.event_free_list;
         poller.event_free_list = evt->free.next;
@@ -201,8 +441,31 @@ static void grow_pollfd_array(void) {
 
     poller.pollfd_array_caps += INIT_PFD_NUM;
     poller.pollfd_array = new;
+
+#if USE_EPOLL
+    if (poller.epoll_fd >= 0) {
+        ssize_t old_size3 = (poller.pollfd_array_caps - INIT_PFD_NUM)*sizeof(*poller.epoll_events);
+        ssize_t new_size3 = poller.pollfd_array_caps*sizeof(*poller.epoll_events);
+        poller.epoll_events = xrealloc(poller.epoll_events, old_size3, new_size3);
+    }
+#endif
 }
 
+#if USE_EPOLL
+static void epoll_update(int op, struct event *evt) {
+    struct pollfd *pfd = &poller.pollfd_array[evt->fd.index];
+    struct epoll_event eev = {
+        .events = pfd->events,
+        .data.u64 = (uint64_t)evt->fd.seq << 32 | (uint32_t)evt->fd.index,
+    };
+
+    /* Deleting is allowed to fail since the file descriptor
+     * might be already closed, which removes it from epoll set. */
+    if (epoll_ctl(poller.epoll_fd, op, abs(pfd->fd), &eev) < 0 && op != EPOLL_CTL_DEL)
+        warn("Can't update epoll set for fd %d: %s", abs(pfd->fd), strerror(errno));
+}
+#endif
+
 void poller_set_autoreset(struct event *evt, struct event **pevt) {
     evt->pptr = pevt;
 }
@@ -233,6 +496,17 @@ struct event *poller_add_fd(poller_fd_cb_t cb, void *arg, int fd, uint32_t mask)
         }
     };
 
+#if USE_IO_URING
+    if (poller.ring.fd >= 0)
+        uring_arm(evt);
+#endif
+#if USE_EPOLL
+    if (poller.epoll_fd >= 0) {
+        evt->fd.seq = poller.fd_seq++;
+        epoll_update(EPOLL_CTL_ADD, evt);
+    }
+#endif
+
     return evt;
 }
 
@@ -280,9 +554,24 @@ static void heap_remove(struct event *evt) {
     evt->timer.index = -1;
 }
 
+static struct timespec timer_deadline(struct event *evt) {
+    struct timespec target = ts_add(&poller.now, evt->timer.period);
+    int64_t slack = evt->timer.slack;
+    if (!slack) return target;
+
+    /* Round to the nearest multiple of slack, so the timer can fire
+     * up to slack/2 earlier or later. Never schedule into the past. */
+    int64_t now = poller.now.tv_sec*SEC + poller.now.tv_nsec;
+    int64_t ns = target.tv_sec*SEC + target.tv_nsec;
+    ns = (ns + slack/2)/slack*slack;
+    if (ns <= now) ns += slack;
+
+    return (struct timespec) { .tv_sec = ns / SEC, .tv_nsec = ns % SEC };
+}
+
 static void heap_insert(struct event *evt) {
     assert(evt->timer.index == -1);
-    evt->timer.current = ts_add(&poller.now, evt->timer.period);
+    evt->timer.current = timer_deadline(evt);
 
     int index = poller.timer_heap_size++;
     if (poller.timer_heap_size > poller.timer_heap_caps)
@@ -295,6 +584,21 @@ static void heap_insert(struct event *evt) {
     poller.timer_heap[index]->timer.index = index;
 }
 
+/* Reschedule the timer in place, this avoids
+ * removing and inserting it back into the heap */
+static void heap_update(struct event *evt) {
+    int index = evt->timer.index;
+    if (index == -1) {
+        heap_insert(evt);
+        return;
+    }
+
+    evt->timer.current = timer_deadline(evt);
+    index = heap_sift_up(index);
+    index = heap_sift_down(index);
+    poller.timer_heap[index]->timer.index = index;
+}
+
 struct event *poller_add_timer(poller_timer_cb_t cb, void *arg, int64_t periodns) {
     struct event *evt = alloc_event();
 
@@ -313,6 +617,35 @@ struct event *poller_add_timer(poller_timer_cb_t cb, void *arg, int64_t periodns
     return evt;
 }
 
+bool poller_set_timer(struct event **pevt, poller_timer_cb_t cb, void *arg, int64_t periodns) {
+    struct event *evt = *pevt;
+
+    /* Reuse the existing timer if possible, since timers
+     * of each window are reset very frequently */
+    if (evt && evt->state == evt_state_timer && evt != poller.current_event) {
+        evt->timer.cb = cb;
+        evt->timer.arg = arg;
+        evt->timer.period = periodns;
+        evt->timer.slack = 0;
+        evt->flags &= ~evt_flag_disabled;
+        heap_update(evt);
+        return true;
+    }
+
+    bool result = poller_unset(pevt);
+    *pevt = poller_add_timer(cb, arg, periodns);
+    poller_set_autoreset(*pevt, pevt);
+    return result;
+}
+
+void poller_set_slack(struct event *evt, int64_t slack) {
+    assert(evt->state == evt_state_timer);
+    if (evt->timer.slack == slack) return;
+    evt->timer.slack = slack;
+    if (evt->timer.index != -1)
+        heap_update(evt);
+}
+
 static void remove_timer(struct event *evt) {
     heap_remove(evt);
     free_event(evt);
@@ -322,6 +655,14 @@ static void remove_fd(struct event *evt) {
     struct pollfd *pfd = &poller.pollfd_array[evt->fd.index];
     assert(poller.current_event != evt);
     assert(poller.pollfd_array_events[evt->fd.index] == evt);
+#if USE_IO_URING
+    if (poller.ring.fd >= 0)
+        uring_disarm(evt);
+#endif
+#if USE_EPOLL
+    if (poller.epoll_fd >= 0 && pfd->fd >= 0)
+        epoll_update(EPOLL_CTL_DEL, evt);
+#endif
     poller.pollfd_array_events[evt->fd.index] = NULL;
     pfd->fd = FREE_SLOT;
     pfd->events = poller.pollfd_first_free;
@@ -367,13 +708,35 @@ static void toggle_timer(struct event *evt, bool enable) {
 }
 
 static void toggle_fd(struct event *evt, bool enable) {
-    (void)enable;
     poller.pollfd_array[evt->fd.index].fd *= -1;
+#if USE_IO_URING
+    if (poller.ring.fd >= 0) {
+        if (enable) uring_arm(evt);
+        else uring_disarm(evt);
+    }
+#endif
+#if USE_EPOLL
+    if (poller.epoll_fd >= 0)
+        epoll_update(enable ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, evt);
+#endif
+    (void)enable;
 }
 
 void poller_fd_set_mask(struct event *evt, uint32_t mask) {
     assert(evt->state == evt_state_fd);
-    poller.pollfd_array[evt->fd.index].events = mask;
+    if (poller_fd_get_mask(evt) == mask) return;
+    struct pollfd *pfd = &poller.pollfd_array[evt->fd.index];
+    pfd->events = mask;
+#if USE_IO_URING
+    if (poller.ring.fd >= 0 && (evt->flags & evt_flag_armed)) {
+        uring_disarm(evt);
+        uring_arm(evt);
+    }
+#endif
+#if USE_EPOLL
+    if (poller.epoll_fd >= 0 && pfd->fd >= 0)
+        epoll_update(EPOLL_CTL_MOD, evt);
+#endif
 }
 
 uint32_t poller_fd_get_mask(struct event *evt) {
@@ -400,54 +763,157 @@ void poller_toggle(struct event *evt, bool enable) {
     }
 }
 
-void poller_run(void) {
-    while (!poller.should_stop) {
-        clock_gettime(CLOCK_TYPE, &poller.now);
+static void dispatch_fd(ssize_t index, uint32_t revents) {
+    struct event *evt = poller.pollfd_array_events[index];
+    if (gconfig.trace_poller || evt->state != evt_state_fd) {
+        info("File[%p, %d, %d] %p(%p, %x)", (void *)evt, evt->state, poller.pollfd_array[evt->fd.index].fd,
+             (void *)(uintptr_t)evt->fd.cb, evt->fd.arg, revents);
+    }
+    assert(evt->state == evt_state_fd);
+    poller.current_event = evt;
+    evt->fd.cb(evt->fd.arg, revents);
 
-#if USE_PPOLL
-        struct timespec top, *timeout = NULL;
-        if (poller.skip_wait) {
-            poller.skip_wait = false;
-            timeout = &top;
-            top = (struct timespec) {0};
-        } else if (poller.timer_heap_size) {
-            timeout = &top;
-            top = ts_sub_sat(&poller.timer_heap[0]->timer.current, &poller.now);
+    poller.current_event = NULL;
+    if (poller.delete_current) {
+        poller.delete_current = false;
+        poller_remove(evt);
+    }
+}
+
+#if USE_EPOLL
+static void epoll_wait_and_dispatch(void) {
+    int timeout = -1;
+    if (poller.skip_wait) {
+        poller.skip_wait = false;
+        timeout = 0;
+    } else if (poller.timer_heap_size) {
+        /* Round up, otherwise we would spin until the timer expires */
+        int64_t diff = ts_diff(&poller.now, &poller.timer_heap[0]->timer.current);
+        timeout = MIN(INT_MAX, MAX(0, (diff + SEC/1000 - 1)/(SEC/1000)));
+    }
+
+    int count = epoll_wait(poller.epoll_fd, poller.epoll_events, poller.pollfd_array_caps, timeout);
+    if (count < 0 && errno != EINTR)
+        warn("Poll error: %s", strerror(errno));
+
+    clock_gettime(CLOCK_TYPE, &poller.now);
+
+    for (int i = 0; i < count; i++) {
+        uint64_t data = poller.epoll_events[i].data.u64;
+        ssize_t index = (uint32_t)data;
+
+        /* The event might have been removed or disabled (and its slot
+         * possibly reused) by one of the previous callbacks. */
+        struct event *evt = poller.pollfd_array_events[index];
+        if (!evt || evt->fd.seq != data >> 32 ||
+            poller.pollfd_array[index].fd < 0) continue;
+
+        dispatch_fd(index, poller.epoll_events[i].events);
+    }
+}
+#endif
+
+#if USE_IO_URING
+static void uring_wait_and_dispatch(void) {
+    struct uring *ring = &poller.ring;
+    struct timespec top, *timeout = NULL;
+    if (poller.skip_wait) {
+        poller.skip_wait = false;
+        timeout = &top;
+        top = (struct timespec) {0};
+    } else if (poller.timer_heap_size) {
+        timeout = &top;
+        top = ts_sub_sat(&poller.timer_heap[0]->timer.current, &poller.now);
+    }
+
+    /* Poll requests re-armed during the previous iteration
+     * are submitted in the same syscall that waits for events */
+    if (uring_enter(1, timeout) < 0 && errno != EINTR && errno != ETIME)
+        warn("Poll error: %s", strerror(errno));
+
+    clock_gettime(CLOCK_TYPE, &poller.now);
+
+    uint32_t head = *ring->cq_head;
+    uint32_t tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        struct io_uring_cqe cqe = ring->cqes[head & ring->cq_mask];
+        __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+        if (cqe.user_data == UINT64_MAX) continue;
+
+        /* The request might be cancelled, or the event might have been
+         * removed or disabled (and its slot possibly reused) by one of
+         * the previous callbacks */
+        ssize_t index = (uint32_t)cqe.user_data;
+        struct event *evt = poller.pollfd_array_events[index];
+        if (!evt || !(evt->flags & evt_flag_armed) ||
+            evt->fd.seq != cqe.user_data >> 32) continue;
+
+        evt->flags &= ~evt_flag_armed;
+        if (cqe.res < 0) {
+            warn("Poll error for fd %d: %s", poller.pollfd_array[index].fd, strerror(-cqe.res));
+            continue;
         }
-        if (ppoll(poller.pollfd_array, poller.pollfd_array_caps, timeout, NULL) < 0 && errno != EINTR)
-            warn("Poll error: %s", strerror(errno));
+
+        dispatch_fd(index, cqe.res);
+
+        if (poller.pollfd_array_events[index] == evt && poller_is_enabled(evt) &&
+            !(evt->flags & evt_flag_armed))
+            uring_arm(evt);
+    }
+}
+#endif
+
+static void poll_and_dispatch(void) {
+#if USE_PPOLL
+    struct timespec top, *timeout = NULL;
+    if (poller.skip_wait) {
+        poller.skip_wait = false;
+        timeout = &top;
+        top = (struct timespec) {0};
+    } else if (poller.timer_heap_size) {
+        timeout = &top;
+        top = ts_sub_sat(&poller.timer_heap[0]->timer.current, &poller.now);
+    }
+    if (ppoll(poller.pollfd_array, poller.pollfd_array_caps, timeout, NULL) < 0 && errno != EINTR)
+        warn("Poll error: %s", strerror(errno));
 #else
-        int timeout = -1;
-        if (poller.skip_wait) {
-            poller.skip_wait = false;
-            timeout = 0;
-        } else if (poller.timer_heap_size) {
-            timeout = MAX(0, ts_diff(&now, &poller.timer_heap[0]->timer.current)/(SEC/1000));
-        }
-        if (poll(poller.pollfd_array, poller.pollfd_array_caps, timeout) < 0 && errno != EINTR)
-            warn("Poll error: %s", strerror(errno));
+    int timeout = -1;
+    if (poller.skip_wait) {
+        poller.skip_wait = false;
+        timeout = 0;
+    } else if (poller.timer_heap_size) {
+        timeout = MAX(0, ts_diff(&poller.now, &poller.timer_heap[0]->timer.current)/(SEC/1000));
+    }
+    if (poll(poller.pollfd_array, poller.pollfd_array_caps, timeout) < 0 && errno != EINTR)
+        warn("Poll error: %s", strerror(errno));
 #endif
-        clock_gettime(CLOCK_TYPE, &poller.now);
+    clock_gettime(CLOCK_TYPE, &poller.now);
 
-        for (ssize_t i = 0; i < poller.pollfd_array_caps; i++) {
-            if (poller.pollfd_array[i].fd >= 0 && poller.pollfd_array[i].revents) {
-                struct event *evt = poller.pollfd_array_events[i];
-                if (gconfig.trace_poller || evt->state != evt_state_fd) {
-                    info("File[%p, %d, %d] %p(%p, %x)", (void *)evt, evt->state, poller.pollfd_array[evt->fd.index].fd,
-                         (void *)(uintptr_t)evt->fd.cb, evt->fd.arg, poller.pollfd_array[i].revents);
-                }
-                assert(evt->state == evt_state_fd);
-                poller.current_event = evt;
-                evt->fd.cb(evt->fd.arg, poller.pollfd_array[i].revents);
-                poller.pollfd_array[i].revents = 0;
-
-                poller.current_event = NULL;
-                if (poller.delete_current) {
-                    poller.delete_current = false;
-                    poller_remove(evt);
-                }
-            }
+    for (ssize_t i = 0; i < poller.pollfd_array_caps; i++) {
+        if (poller.pollfd_array[i].fd >= 0 && poller.pollfd_array[i].revents) {
+            uint32_t revents = poller.pollfd_array[i].revents;
+            poller.pollfd_array[i].revents = 0;
+            dispatch_fd(i, revents);
         }
+    }
+}
+
+void poller_run(void) {
+    while (!poller.should_stop) {
+        clock_gettime(CLOCK_TYPE, &poller.now);
+
+#if USE_IO_URING
+        if (poller.ring.fd >= 0)
+            uring_wait_and_dispatch();
+        else
+#endif
+#if USE_EPOLL
+        if (poller.epoll_fd >= 0)
+            epoll_wait_and_dispatch();
+        else
+#endif
+            poll_and_dispatch();
 
         struct timespec now2 = ts_add(&poller.now, 10000);
 
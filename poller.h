@@ -1,4 +1,4 @@
-/* Copyright (c) 2024, Evgeniy Baskov. All rights reserved */
+/* Copyright (c) 2024,2026, Evgeniy Baskov. All rights reserved */
 
 #ifndef POLLER_H_
 #define POLLER_H_ 1
@@ -26,6 +26,10 @@ void poller_stop(void);
 void poller_run(void);
 void poller_set_autoreset(struct event *evt, struct event **pevt);
 void poller_skip_wait(void);
+/* Allow the timer to fire up to slack/2 earlier or later,
+ * so that timers with the same slack are coalesced */
+void poller_set_slack(struct event *evt, int64_t slack);
+bool poller_set_timer(struct event **pevt, poller_timer_cb_t cb, void *arg, int64_t periodns);
 void poller_fd_set_mask(struct event *evt, uint32_t mask);
 uint32_t poller_fd_get_mask(struct event *evt);
 
@@ -35,13 +39,6 @@ static inline bool poller_unset(struct event **evt) {
     return true;
 }
 
-static inline bool poller_set_timer(struct event **evt, poller_timer_cb_t cb, void *arg, int64_t periodns) {
-    bool result = poller_unset(evt);
-    *evt = poller_add_timer(cb, arg, periodns);
-    poller_set_autoreset(*evt, evt);
-    return result;
-}
-
 void init_poller(void);
 void free_poller(void);
 
@@ -1,4 +1,4 @@
-/* Copyright (c) 2019-2022, Evgeniy Baskov. All rights reserved */
+/* Copyright (c) 2019-2022,2025-2026, Evgeniy Baskov. All rights reserved */
 
 
 #include "feature.h"
@@ -21,8 +21,75 @@
 #include <xcb/xcb.h>
 
 static bool has_shm_pixmaps;
+static bool double_buffer;
+static uint8_t shm_first_event;
 extern bool has_fast_damage;
 
+static void set_full_damage(struct window *win) {
+    get_plat(win)->shm_full_damage = true;
+    get_plat(win)->shm_damage_count = 0;
+}
+
+static void push_damage(struct window *win, struct rect rect) {
+    struct platform_window *plat = get_plat(win);
+    if (plat->shm_full_damage) return;
+
+    /* Don't bother tracking too many regions */
+    if (plat->shm_damage_count >= 4*(size_t)win->c.height) {
+        set_full_damage(win);
+        return;
+    }
+
+    adjust_buffer((void **)&plat->shm_damage, &plat->shm_damage_caps,
+                  plat->shm_damage_count + 1, sizeof *plat->shm_damage);
+    plat->shm_damage[plat->shm_damage_count++] = rect;
+}
+
+static void swap_buffers(struct window *win) {
+    struct platform_window *plat = get_plat(win);
+
+    /* Bring spare image up to date before drawing to it */
+    if (plat->shm_full_damage) {
+        image_copy(plat->shm_spare_im, (struct rect) {0, 0, plat->shm.im.width, plat->shm.im.height}, plat->shm.im, 0, 0);
+    } else {
+        for (size_t i = 0; i < plat->shm_damage_count; i++) {
+            struct rect r = plat->shm_damage[i];
+            image_copy(plat->shm_spare_im, r, plat->shm.im, r.x, r.y);
+        }
+    }
+
+    plat->shm_damage_count = 0;
+    plat->shm_full_damage = false;
+
+    SWAP(plat->shm.im, plat->shm_spare_im);
+    SWAP(plat->shm_seg, plat->shm_spare_seg);
+    SWAP(plat->shm_pending, plat->shm_spare_pending);
+
+    if (plat->shm_swap_pending) {
+        plat->shm_swap_pending = false;
+        win->inhibit_render_counter--;
+    }
+}
+
+static void wait_for_server(struct window *win) {
+    /* Any reply is only sent after all previous requests are
+     * processed, so both segments are free after the round trip */
+    free(xcb_get_input_focus_reply(con, xcb_get_input_focus(con), NULL));
+    get_plat(win)->shm_pending = 0;
+    get_plat(win)->shm_spare_pending = 0;
+    if (gconfig.trace_misc)
+        info("Waited for MIT-SHM segment");
+}
+
+/* Make sure that X server does not read the image we are going to modify */
+static void prepare_image(struct window *win) {
+    if (!double_buffer || !get_plat(win)->shm_pending) return;
+
+    if (get_plat(win)->shm_spare_pending)
+        wait_for_server(win);
+    swap_buffers(win);
+}
+
 /* Returns old image */
 struct image x11_shm_create_image(struct window *win, int16_t width, int16_t height) {
     struct image old = get_plat(win)->shm.im;
@@ -46,6 +113,34 @@ struct image x11_shm_create_image(struct window *win, int16_t width, int16_t hei
 #endif
         if (check_void_cookie(c)) goto error;
 
+        if (double_buffer) {
+            struct image old_spare = get_plat(win)->shm_spare_im;
+            get_plat(win)->shm_spare_im = create_shm_image(width, height);
+            free_image(&old_spare);
+
+            if (!get_plat(win)->shm_spare_seg)
+                get_plat(win)->shm_spare_seg = xcb_generate_id(con);
+            else
+                xcb_shm_detach(con, get_plat(win)->shm_spare_seg);
+
+#if USE_POSIX_SHM
+            c = xcb_shm_attach_fd_checked(con, get_plat(win)->shm_spare_seg, dup(get_plat(win)->shm_spare_im.shmid), 0);
+#else
+            c = xcb_shm_attach_checked(con, get_plat(win)->shm_spare_seg, get_plat(win)->shm_spare_im.shmid, 0);
+#endif
+            if (check_void_cookie(c)) goto error;
+
+            /* Both segments are new, completions of
+             * the old requests should be ignored */
+            get_plat(win)->shm_pending = 0;
+            get_plat(win)->shm_spare_pending = 0;
+            if (get_plat(win)->shm_swap_pending) {
+                get_plat(win)->shm_swap_pending = false;
+                win->inhibit_render_counter--;
+            }
+            set_full_damage(win);
+        }
+
         if (has_shm_pixmaps) {
             if (!get_plat(win)->shm_pixmap)
                 get_plat(win)->shm_pixmap = xcb_generate_id(con);
@@ -70,8 +165,13 @@ void x11_shm_update(struct window *win, struct rect rect) {
     if (has_shm_pixmaps) {
         xcb_copy_area(con, get_plat(win)->shm_pixmap, get_plat(win)->wid, get_plat(win)->gc, rect.x, rect.y, rect.x, rect.y, rect.width, rect.height);
     } else if (has_fast_damage) {
-        xcb_shm_put_image(con, get_plat(win)->wid, get_plat(win)->gc, STRIDE(get_plat(win)->shm.im.width), get_plat(win)->shm.im.height, rect.x, rect.y,
-                rect.width, rect.height, rect.x, rect.y, TRUE_COLOR_ALPHA_DEPTH, XCB_IMAGE_FORMAT_Z_PIXMAP, 0, get_plat(win)->shm_seg, 0);
+        xcb_void_cookie_t c = xcb_shm_put_image(con, get_plat(win)->wid, get_plat(win)->gc,
+                STRIDE(get_plat(win)->shm.im.width), get_plat(win)->shm.im.height, rect.x, rect.y, rect.width, rect.height,
+                rect.x, rect.y, TRUE_COLOR_ALPHA_DEPTH, XCB_IMAGE_FORMAT_Z_PIXMAP, double_buffer, get_plat(win)->shm_seg, 0);
+        if (double_buffer) {
+            get_plat(win)->shm_pending = c.sequence;
+            push_damage(win, rect);
+        }
     } else {
         xcb_put_image(con, XCB_IMAGE_FORMAT_Z_PIXMAP, get_plat(win)->wid, get_plat(win)->gc,
                 STRIDE(get_plat(win)->shm.im.width), rect.height, 0, rect.y, 0, TRUE_COLOR_ALPHA_DEPTH,
@@ -80,13 +180,71 @@ void x11_shm_update(struct window *win, struct rect rect) {
     }
 }
 
+bool x11_shm_submit_screen(struct window *win, int16_t cur_x, ssize_t cur_y, bool cursor, bool marg) {
+    prepare_image(win);
+    return shm_submit_screen(win, cur_x, cur_y, cursor, marg);
+}
+
+void x11_shm_copy(struct window *win, struct rect dst, int16_t sx, int16_t sy) {
+    prepare_image(win);
+    shm_copy(win, dst, sx, sy);
+}
+
+void x11_shm_recolor_border(struct window *win) {
+    prepare_image(win);
+    shm_recolor_border(win);
+}
+
+void x11_shm_draw_end(struct window *win) {
+    if (!double_buffer || !get_plat(win)->shm_pending) return;
+
+    if (!get_plat(win)->shm_spare_pending) {
+        swap_buffers(win);
+    } else if (!get_plat(win)->shm_swap_pending) {
+        /* X server is still reading both images, so skip
+         * frames until the spare one is released. */
+        get_plat(win)->shm_swap_pending = true;
+        win->inhibit_render_counter++;
+        if (gconfig.trace_misc)
+            info("X server is busy, delaying frame");
+    }
+}
+
+void x11_shm_handle_completion(struct window *win, xcb_shm_seg_t seg, uint32_t sequence) {
+    struct platform_window *plat = get_plat(win);
+    /* Completion events arrive in request order */
+    if (seg == plat->shm_seg && plat->shm_pending &&
+            (int32_t)(sequence - plat->shm_pending) >= 0) {
+        plat->shm_pending = 0;
+    } else if (seg == plat->shm_spare_seg && plat->shm_spare_pending &&
+            (int32_t)(sequence - plat->shm_spare_pending) >= 0) {
+        plat->shm_spare_pending = 0;
+        if (plat->shm_swap_pending)
+            swap_buffers(win);
+    }
+}
+
+uint8_t x11_shm_completion_event(void) {
+    return double_buffer ? shm_first_event + XCB_SHM_COMPLETION : 0;
+}
+
 void x11_shm_free(struct window *win) {
+    /* Window can be detached while waiting for the swap */
+    if (get_plat(win)->shm_swap_pending) {
+        get_plat(win)->shm_swap_pending = false;
+        win->inhibit_render_counter--;
+    }
     if (has_fast_damage)
         xcb_shm_detach(con, get_plat(win)->shm_seg);
+    if (double_buffer && get_plat(win)->shm_spare_seg)
+        xcb_shm_detach(con, get_plat(win)->shm_spare_seg);
     if (has_shm_pixmaps)
         xcb_free_pixmap(con, get_plat(win)->shm_pixmap);
     if (get_plat(win)->shm.im.data)
         free_image(&get_plat(win)->shm.im);
+    if (get_plat(win)->shm_spare_im.data)
+        free_image(&get_plat(win)->shm_spare_im);
+    free(get_plat(win)->shm_damage);
     free(get_plat(win)->shm.bounds);
 }
 
@@ -119,4 +277,13 @@ void x11_shm_init_context(void) {
             warn("MIT-SHM is not available");
         }
     }
+
+    /* Double buffering relies on completion events
+     * of ShmPutImage, so shared pixmaps are not used */
+    if ((double_buffer = gconfig.double_buffer && has_fast_damage)) {
+        has_shm_pixmaps = false;
+        shm_first_event = xcb_get_extension_data(con, &xcb_shm_id)->first_event;
+    } else if (gconfig.double_buffer) {
+        warn("Double buffering requires MIT-SHM");
+    }
 }
@@ -118,13 +118,18 @@ bool shm_submit_screen(struct window *win, int16_t cur_x, ssize_t cur_y, bool cu
 
     bool slow_path = win->cfg.special_bold || win->cfg.special_underline || win->cfg.special_blink || win->cfg.blend_fg ||
                      win->cfg.special_reverse || win->cfg.special_italic || win->cfg.blend_all_bg || selection_active(term_get_sstate(win->term));
+    color_memo_reset(&win->rcstate);
     bool reverse_cursor = cursor_visible && win->focused && ((win->cfg.cursor_shape + 1) & ~1) == cursor_type_block;
 
     struct screen *scr = term_screen(win->term);
     struct line_span span = screen_view(scr);
     struct line *prev_line = NULL;
+    uint64_t repainted = 0, fetched = 0, missed = 0;
+    prepare_blink_rows(win);
     for (ssize_t k = 0; k < win->c.height; k++, screen_span_shift(scr, &span)) {
         screen_span_width(scr, &span);
+        if (!row_needs_redraw(win, k, cur_y)) continue;
+        bool row_blinking = false;
         bool next_dirty = false;
         struct rect l_bound = {-1, k, 0, 1};
 
@@ -148,7 +153,7 @@ bool shm_submit_screen(struct window *win, int16_t cur_x, ssize_t cur_y, bool cu
 
             struct attr attr = *view_attr(&span, cel.attrid);
             bool dirty = span.line->force_damage || !cel.drawn || (!win->blink_committed && attr.blink);
-            has_blinking |= attr.blink;
+            row_blinking |= attr.blink;
 
             struct cellspec spec;
             struct glyph *glyph = NULL;
@@ -164,7 +169,15 @@ bool shm_submit_screen(struct window *win, int16_t cur_x, ssize_t cur_y, bool cu
                 bool selected = is_selected_prev(&sel_it, &span, i);
                 spec = describe_cell(cel, &attr, &win->cfg, &win->rcstate, selected, slow_path);
 
-                if (spec.ch) glyph = glyph_cache_fetch(win->font_cache, spec.ch, spec.face, NULL);
+                if (spec.ch) {
+                    bool is_new = false;
+                    bool pending;
+                    glyph = glyph_cache_fetch_async(win->font_cache, spec.ch, spec.face, &is_new, &pending);
+                    /* Cell is drawn without glyph for now and repainted once it is ready */
+                    if (UNLIKELY(pending)) pcell->drawn = false;
+                    missed += is_new;
+                    fetched++;
+                }
                 g_wide = glyph && glyph->x_off > win->char_width - win->cfg.font_spacing;
             }
 
@@ -177,6 +190,7 @@ bool shm_submit_screen(struct window *win, int16_t cur_x, ssize_t cur_y, bool cu
                 struct rect r_cell = { x, y, cw * (1 + spec.wide), ch + cd};
                 struct rect r_under = { x + fs, y + ch + 1 + ls, cw, ul };
                 struct rect r_strike = { x + fs, y + 2*ch/3 - ul/2 + ls, cw, ul };
+                repainted++;
 
                 /* Background */
                 image_draw_rect(get_shm(win)->im, r_cell, spec.bg);
@@ -210,6 +224,8 @@ bool shm_submit_screen(struct window *win, int16_t cur_x, ssize_t cur_y, bool cu
             }
             next_dirty = dirty;
         }
+        win->blink_rows[k] = row_blinking;
+        has_blinking |= row_blinking;
 
         if (l_bound.x >= 0 || span.line->force_damage || (scrolled && win->c.width > span.width)) {
             if (win->c.width > span.width) {
@@ -238,6 +254,10 @@ bool shm_submit_screen(struct window *win, int16_t cur_x, ssize_t cur_y, bool cu
     if (prev_line)
         prev_line->force_damage = false;
 
+    stats_add(&win->stats, stat_cells_repainted, repainted);
+    stats_add(&win->stats, stat_glyph_hits, fetched - missed);
+    stats_add(&win->stats, stat_glyph_misses, missed);
+
     if (cursor_visible) {
         struct cursor_rects cr = describe_cursor(win, cur_x, cur_y, on_margin, beyond_eol);
         for (size_t i = 0; i < cr.count; i++)
@@ -84,6 +84,20 @@ struct render_context {
     uint32_t *free_ids;
     size_t id_capacity;
     size_t id_count;
+
+    /* New glyphs are collected here and uploaded to the
+     * glyph set with a single request before drawing */
+    xcb_render_glyphset_t upload_gsid;
+    uint32_t *upload_ids;
+    size_t upload_ids_caps;
+    xcb_render_glyphinfo_t *upload_info;
+    size_t upload_info_caps;
+    size_t upload_count;
+    uint8_t *upload_data;
+    size_t upload_data_caps;
+    size_t upload_data_size;
+    /* Maximal request size in bytes */
+    size_t upload_max;
 };
 
 static struct render_context rctx;
@@ -115,6 +129,37 @@ static void free_cached_id(uint32_t id) {
     rctx.free_ids[rctx.id_count++] = id;
 }
 
+static void flush_glyph_uploads(void) {
+    if (!rctx.upload_count) return;
+
+    xcb_render_add_glyphs(con, rctx.upload_gsid, rctx.upload_count, rctx.upload_ids,
+                          rctx.upload_info, rctx.upload_data_size, rctx.upload_data);
+
+    rctx.upload_count = 0;
+    rctx.upload_data_size = 0;
+}
+
+static void queue_glyph_upload(xcb_render_glyphset_t gsid, uint32_t ch, xcb_render_glyphinfo_t *spec, struct glyph *glyph) {
+    size_t data_size = glyph->height*glyph->stride;
+    /* Also reserve space for BIG-REQUESTS length field */
+    size_t request_size = sizeof(xcb_render_add_glyphs_request_t) + sizeof(uint32_t) +
+            (rctx.upload_count + 1)*(sizeof ch + sizeof *spec) + rctx.upload_data_size + data_size;
+
+    if (rctx.upload_gsid != gsid || request_size > rctx.upload_max)
+        flush_glyph_uploads();
+
+    rctx.upload_gsid = gsid;
+
+    adjust_buffer((void **)&rctx.upload_ids, &rctx.upload_ids_caps, rctx.upload_count + 1, sizeof *rctx.upload_ids);
+    adjust_buffer((void **)&rctx.upload_info, &rctx.upload_info_caps, rctx.upload_count + 1, sizeof *rctx.upload_info);
+    adjust_buffer((void **)&rctx.upload_data, &rctx.upload_data_caps, rctx.upload_data_size + data_size, 1);
+
+    rctx.upload_ids[rctx.upload_count] = ch;
+    rctx.upload_info[rctx.upload_count++] = *spec;
+    memcpy(rctx.upload_data + rctx.upload_data_size, glyph->data, data_size);
+    rctx.upload_data_size += data_size;
+}
+
 static void register_glyph(struct window *win, uint32_t ch, struct glyph *glyph) {
     if (glyph->pixmode == pixmode_bgra) {
         glyph->id = alloc_cached_id();
@@ -138,8 +183,7 @@ static void register_glyph(struct window *win, uint32_t ch, struct glyph *glyph)
             .x_off = win->char_width*(1 + (uwidth(ch & 0xFFFFFF) > 1)), .y_off = glyph->y_off
         };
 
-        xcb_render_add_glyphs(con, get_plat(win)->gsid, 1, &ch, &spec,
-                              glyph->height*glyph->stride, glyph->data);
+        queue_glyph_upload(get_plat(win)->gsid, ch, &spec, glyph);
     }
 }
 
@@ -208,25 +252,30 @@ void x11_xrender_release_glyph(struct glyph *glyph) {
     }
 }
 
+void x11_xrender_release_glyph_set(uint32_t gsid) {
+    if (rctx.upload_gsid == gsid) {
+        rctx.upload_count = 0;
+        rctx.upload_data_size = 0;
+        rctx.upload_gsid = 0;
+    }
+    xcb_render_free_glyph_set(con, gsid);
+}
+
 bool x11_xrender_reload_font(struct window *win, bool need_free) {
-    struct window *found = window_find_shared_font(win, need_free, false);
+    window_find_shared_font(win, need_free, false);
 
     get_plat(win)->pfglyph = win->cfg.pixel_mode ? rctx.pfargb : rctx.pfalpha;
 
     xcb_void_cookie_t c;
 
-    if (need_free) {
-        c = xcb_render_free_glyph_set_checked(con, get_plat(win)->gsid);
-        if (check_void_cookie(c)) warn("Can't free glyph set");
-    }
-    else get_plat(win)->gsid = xcb_generate_id(con);
-
-    if (found && win->font_pixmode == found->font_pixmode) {
-        c = xcb_render_reference_glyph_set_checked(con, get_plat(win)->gsid, get_plat(found)->gsid);
-        if (check_void_cookie(c)) warn("Can't reference glyph set");
-    } else {
+    /* Glyph set lives as long as the glyph cache, so every glyph
+     * is uploaded once for all windows using the same cache */
+    get_plat(win)->gsid = glyph_cache_get_glyph_set(win->font_cache);
+    if (!get_plat(win)->gsid) {
+        get_plat(win)->gsid = xcb_generate_id(con);
         c = xcb_render_create_glyph_set_checked(con, get_plat(win)->gsid, get_plat(win)->pfglyph);
         if (check_void_cookie(c)) warn("Can't create glyph set");
+        glyph_cache_set_glyph_set(win->font_cache, get_plat(win)->gsid);
 
         for (uint32_t i = ' '; i <= '~'; i++) {
             struct glyph *glyph = glyph_cache_fetch(win->font_cache, i, face_normal, NULL);
@@ -235,6 +284,7 @@ bool x11_xrender_reload_font(struct window *win, bool need_free) {
         }
 
         register_glyph(win, GLYPH_UNDERCURL, win->undercurl_glyph);
+        flush_glyph_uploads();
     }
 
     if (need_free) {
@@ -297,7 +347,6 @@ void x11_xrender_free(struct window *win) {
     xcb_render_free_picture(con, get_plat(win)->pen);
     xcb_render_free_picture(con, get_plat(win)->pic1);
     xcb_free_pixmap(con, get_plat(win)->pid1);
-    xcb_render_free_glyph_set(con, get_plat(win)->gsid);
 }
 
 static void xrender_init_context(void) {
@@ -347,6 +396,8 @@ static void xrender_init_context(void) {
 
     rctx.free_ids = xalloc(FREE_IDS_INIT_CAPS * sizeof *rctx.free_ids);
     rctx.id_capacity = FREE_IDS_INIT_CAPS;
+
+    rctx.upload_max = xcb_get_maximum_request_length(con) * sizeof(uint32_t);
 }
 
 void x11_xrender_update(struct window *win, struct rect rect) {
@@ -483,6 +534,9 @@ void x11_xrender_free_context(void) {
     free(rctx.payload);
     free(rctx.glyphs);
     free(rctx.free_ids);
+    free(rctx.upload_ids);
+    free(rctx.upload_info);
+    free(rctx.upload_data);
     free_elem_buffer(&rctx.foreground_buf);
     free_elem_buffer(&rctx.background_buf);
     free_elem_buffer(&rctx.decoration_buf);
@@ -515,8 +569,8 @@ static void push_rect(struct rect *rect) {
 }
 
 static inline void push_element(struct element_buffer *dst, struct element *elem) {
-    /* We need buffer twice as big a the number of elements to
-     * be able to use merge sort efficiently */
+    /* We need buffer twice as big a the number of elements
+     * to be able to sort them without extra allocations */
     adjust_buffer((void **)&dst->data, &dst->caps, 2*(dst->size + 1), sizeof *elem);
     dst->data[dst->size++] = *elem;
 }
@@ -538,19 +592,32 @@ static inline uint32_t push_char(uint32_t ch) {
     return new_pos;
 }
 
+/* Stable LSD radix sort by color, one byte per pass.
+ * Passes for bytes that are the same for all
+ * elements (usually alpha) are skipped. */
 static inline void sort_by_color(struct element_buffer *buf) {
     struct element *dst = buf->data + buf->size, *src = buf->data;
-    for (size_t k = 2; k < 2*buf->size; k += k) {
-        for (size_t i = 0; i < buf->size; ) {
-            size_t l_1 = i, h_1 = MIN(i + k/2, buf->size);
-            size_t l_2 = h_1, h_2 = MIN(i + k, buf->size);
-            while (l_1 < h_1 && l_2 < h_2)
-                dst[i++] = src[src[l_1].color < src[l_2].color ? l_1++ : l_2++];
-            while (l_1 < h_1) dst[i++] = src[l_1++];
-            while (l_2 < h_2) dst[i++] = src[l_2++];
+    uint32_t count[sizeof(color_t)][256] = {{0}};
+
+    for (size_t i = 0; i < buf->size; i++)
+        for (size_t b = 0; b < sizeof(color_t); b++)
+            count[b][(src[i].color >> 8*b) & 0xFF]++;
+
+    for (size_t b = 0; buf->size && b < sizeof(color_t); b++) {
+        if (count[b][(src[0].color >> 8*b) & 0xFF] == buf->size) continue;
+
+        uint32_t offset = 0;
+        for (size_t j = 0; j < 256; j++) {
+            uint32_t n = count[b][j];
+            count[b][j] = offset;
+            offset += n;
         }
+
+        for (size_t i = 0; i < buf->size; i++)
+            dst[count[b][(src[i].color >> 8*b) & 0xFF]++] = src[i];
         SWAP(dst, src);
     }
+
     buf->sorted = src;
 }
 
@@ -564,13 +631,18 @@ static bool prepare_multidraw(struct window *win, int16_t cur_x, ssize_t cur_y,
 
     bool slow_path = win->cfg.special_bold || win->cfg.special_underline || win->cfg.special_blink || win->cfg.blend_fg ||
                      win->cfg.special_reverse || win->cfg.special_italic || win->cfg.blend_all_bg || selection_active(term_get_sstate(win->term));
+    color_memo_reset(&win->rcstate);
     bool has_blinking = false;
 
     struct screen *scr = term_screen(win->term);
     struct line_span span = screen_view(scr);
     struct line *prev_line = NULL;
+    uint64_t repainted = 0, fetched = 0, missed = 0;
+    prepare_blink_rows(win);
     for (ssize_t k = 0; k < win->c.height; k++, screen_span_shift(scr, &span)) {
         screen_span_width(scr, &span);
+        if (!row_needs_redraw(win, k, cur_y)) continue;
+        bool row_blinking = false;
         bool next_dirty = false, first_in_line = true;
 
         struct mouse_selection_iterator sel_it = selection_begin_iteration(term_get_sstate(win->term), &span);
@@ -610,7 +682,7 @@ static bool prepare_multidraw(struct window *win, int16_t cur_x, ssize_t cur_y,
 
             struct attr attr = *view_attr(&span, cel.attrid);
             bool dirty = span.line->force_damage || !cel.drawn || (!win->blink_committed && attr.blink);
-            has_blinking |= attr.blink;
+            row_blinking |= attr.blink;
 
             struct cellspec spec;
             struct glyph *glyph = NULL;
@@ -628,7 +700,14 @@ static bool prepare_multidraw(struct window *win, int16_t cur_x, ssize_t cur_y,
                 g =  spec.ch | (spec.face << 24);
 
                 bool is_new = false;
-                if (spec.ch) glyph = glyph_cache_fetch(win->font_cache, spec.ch, spec.face, &is_new);
+                if (spec.ch) {
+                    bool pending;
+                    glyph = glyph_cache_fetch_async(win->font_cache, spec.ch, spec.face, &is_new, &pending);
+                    /* Cell is drawn without glyph for now and repainted once it is ready */
+                    if (UNLIKELY(pending)) pcell->drawn = false;
+                    missed += is_new;
+                    fetched++;
+                }
 
                 if (UNLIKELY(is_new) && glyph) register_glyph(win, g, glyph);
 
@@ -636,6 +715,7 @@ static bool prepare_multidraw(struct window *win, int16_t cur_x, ssize_t cur_y,
             }
             if (dirty || (g_wide && next_dirty)) {
                 int16_t y = k * (win->char_depth + win->char_height);
+                repainted++;
 
                 /* Queue background, grouping by color */
 
@@ -767,6 +847,8 @@ static bool prepare_multidraw(struct window *win, int16_t cur_x, ssize_t cur_y,
             }
             next_dirty = dirty;
         }
+        win->blink_rows[k] = row_blinking;
+        has_blinking |= row_blinking;
         /* Only reset force flag for last part of the line */
         if (prev_line != span.line && prev_line)
             prev_line->force_damage = false;
@@ -774,6 +856,10 @@ static bool prepare_multidraw(struct window *win, int16_t cur_x, ssize_t cur_y,
     }
     if (prev_line)
         prev_line->force_damage = false;
+
+    stats_add(&win->stats, stat_cells_repainted, repainted);
+    stats_add(&win->stats, stat_glyph_hits, fetched - missed);
+    stats_add(&win->stats, stat_glyph_misses, missed);
     return has_blinking;
 }
 
@@ -833,6 +919,7 @@ bool x11_xrender_submit_screen(struct window *win, int16_t cur_x, ssize_t cur_y,
     bool reverse_cursor = cursor_visible && win->focused && ((win->cfg.cursor_shape + 1) & ~1) == cursor_type_block;
 
     has_blinking |= prepare_multidraw(win, cur_x, cur_y, reverse_cursor, &beyond_eol, &cursor_visible);
+    flush_glyph_uploads();
 
     sort_by_color(&rctx.background_buf);
     set_clip(win, &rctx.background_buf);
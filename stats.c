@@ -0,0 +1,101 @@
+/* Copyright (c) 2026, Evgeniy Baskov. All rights reserved */
+
+#include "feature.h"
+
+#include "stats.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+static const char *counter_names[stat_counter_MAX] = {
+    [stat_bytes_parsed] = "bytes-parsed",
+    [stat_cells_repainted] = "cells-repainted",
+    [stat_frames] = "frames",
+    [stat_frames_dropped] = "frames-dropped",
+    [stat_glyph_hits] = "glyph-hits",
+    [stat_glyph_misses] = "glyph-misses",
+    [stat_reads_throttled] = "reads-throttled",
+    [stat_bytes_deferred] = "bytes-deferred",
+};
+
+static const char *timer_names[stat_timer_MAX] = {
+    [stat_read] = "read",
+    [stat_submit] = "submit",
+    [stat_flush] = "flush",
+    [stat_vblank] = "vblank",
+    [stat_key_write] = "key-write",
+    [stat_key_echo] = "key-echo",
+    [stat_key_draw] = "key-draw",
+    [stat_key_vblank] = "key-vblank",
+    [stat_key_total] = "key-total",
+};
+
+void stats_record(struct stats *stats, enum stat_timer timer, int64_t ns) {
+    struct histogram *hist = &stats->timers[timer];
+    uint64_t us = MAX(0, ns) / 1000;
+    size_t bucket = us ? 64 - __builtin_clzll(us) : 0;
+
+    hist->buckets[MIN(bucket, STAT_HIST_BUCKETS - 1)]++;
+    hist->count++;
+    hist->total += MAX(0, ns);
+    hist->max = MAX(hist->max, ns);
+}
+
+/* Returns upper bound of the percentile in microseconds */
+uint64_t stats_percentile(struct stats *stats, enum stat_timer timer, uint64_t permille) {
+    struct histogram *hist = &stats->timers[timer];
+    uint64_t target = (hist->count * permille + 999) / 1000, sum = 0;
+    for (size_t i = 0; i < STAT_HIST_BUCKETS - 1; i++)
+        if ((sum += hist->buckets[i]) >= target)
+            return UINT64_C(1) << i;
+    return hist->max / 1000;
+}
+
+static void append(char *buf, size_t size, size_t *pos, const char *fmt, ...) __attribute__ ((format (printf, 4, 5)));
+
+static void append(char *buf, size_t size, size_t *pos, const char *fmt, ...) {
+    if (*pos >= size) return;
+
+    va_list args;
+    va_start(args, fmt);
+    int res = vsnprintf(buf + *pos, size - *pos, fmt, args);
+    va_end(args);
+
+    if (res > 0) *pos = MIN(size - 1, *pos + res);
+}
+
+size_t stats_format(struct stats *stats, const char *name, char *buf, size_t size) {
+    size_t pos = 0;
+    if (!size) return 0;
+    *buf = '\0';
+
+    append(buf, size, &pos, "%s:\n ", name);
+    for (size_t i = 0; i < stat_counter_MAX; i++)
+        append(buf, size, &pos, " %s=%"PRIu64, counter_names[i], stats->counters[i]);
+
+    /* Time spent parsing and rendering, i.e. CPU time used on behalf of the window */
+    int64_t cpu_time = stats->timers[stat_read].total + stats->timers[stat_submit].total +
+            stats->timers[stat_flush].total;
+    append(buf, size, &pos, " cpu-time=%.1fms\n", cpu_time / 1e6);
+
+    for (size_t i = 0; i < stat_timer_MAX; i++) {
+        struct histogram *hist = &stats->timers[i];
+        if (!hist->count) continue;
+
+        append(buf, size, &pos, "  %s: count=%"PRIu64" avg=%.1fus p50<%"PRIu64"us p99<%"PRIu64"us max=%.1fus\n   ",
+               timer_names[i], hist->count, hist->total / (1000. * hist->count),
+               stats_percentile(stats, i, 500), stats_percentile(stats, i, 990), hist->max / 1000.);
+
+        for (size_t j = 0; j < STAT_HIST_BUCKETS; j++) {
+            if (!hist->buckets[j]) continue;
+            if (j < STAT_HIST_BUCKETS - 1)
+                append(buf, size, &pos, " <%"PRIu64"us:%"PRIu32, UINT64_C(1) << j, hist->buckets[j]);
+            else
+                append(buf, size, &pos, " >=%"PRIu64"us:%"PRIu32, UINT64_C(1) << (j - 1), hist->buckets[j]);
+        }
+        append(buf, size, &pos, "\n");
+    }
+
+    return pos;
+}
@@ -0,0 +1,79 @@
+/* Copyright (c) 2026, Evgeniy Baskov. All rights reserved */
+
+#ifndef STATS_H_
+#define STATS_H_ 1
+
+#include "feature.h"
+
+#include "util.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Histogram bucket N holds durations shorter than 2^N microseconds,
+ * the last bucket holds everything else */
+#define STAT_HIST_BUCKETS 24
+
+enum stat_counter {
+    stat_bytes_parsed,
+    stat_cells_repainted,
+    stat_frames,
+    stat_frames_dropped,
+    stat_glyph_hits,
+    stat_glyph_misses,
+    stat_reads_throttled,
+    stat_bytes_deferred,
+    stat_counter_MAX,
+};
+
+enum stat_timer {
+    stat_read,
+    stat_submit,
+    stat_flush,
+    stat_vblank,
+    /* Keypress latency stages, only with --trace-latency */
+    stat_key_write,
+    stat_key_echo,
+    stat_key_draw,
+    stat_key_vblank,
+    stat_key_total,
+    stat_timer_MAX,
+};
+
+struct histogram {
+    uint64_t count;
+    int64_t total;
+    int64_t max;
+    uint32_t buckets[STAT_HIST_BUCKETS];
+};
+
+struct stats {
+    uint64_t counters[stat_counter_MAX];
+    struct histogram timers[stat_timer_MAX];
+};
+
+/* Called for each chunk of formatted statistics,
+ * returns false if output should be stopped */
+typedef bool (*stats_sink_t)(void *arg, const char *str);
+
+void stats_record(struct stats *stats, enum stat_timer timer, int64_t ns);
+uint64_t stats_percentile(struct stats *stats, enum stat_timer timer, uint64_t permille);
+size_t stats_format(struct stats *stats, const char *name, char *buf, size_t size);
+
+static inline void stats_add(struct stats *stats, enum stat_counter counter, uint64_t value) {
+    stats->counters[counter] += value;
+}
+
+static inline void stats_begin(struct timespec *start) {
+    clock_gettime(CLOCK_TYPE, start);
+}
+
+static inline void stats_end(struct stats *stats, enum stat_timer timer, struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_TYPE, &end);
+    stats_record(stats, timer, ts_diff(start, &end));
+}
+
+#endif
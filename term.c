@@ -33,6 +33,9 @@
 #include <time.h>
 #include <unistd.h>
 #include <wchar.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define ESC_MAX_PARAM 32
 #define ESC_MAX_STR 256
@@ -134,6 +137,9 @@ struct term {
         uint8_t from;
         uint8_t leftover[3];
         uint8_t leftover_len;
+        /* Incomplete UTF-8 sequence from the previous block */
+        uint8_t partial[UTF8_MAX_LEN];
+        uint8_t partial_len;
         bool bracketed : 1;
         bool quote : 1;
         bool literal_nl : 1;
@@ -3484,6 +3490,14 @@ static inline void apply_matched_uri(struct term *term) {
 
 HOT
 static void do_read(struct term *term) {
+    struct stats *stats = window_stats(screen_window(&term->scr));
+    ssize_t len = term->tty.end - term->tty.start;
+    struct timespec start;
+    stats_begin(&start);
+
+    if (UNLIKELY(gconfig.trace_latency))
+        window_trace_latency(screen_window(&term->scr), latency_echoed);
+
     term->requested_resize = false;
     printer_intercept(screen_printer(&term->scr), (const uint8_t **)&term->tty.start, term->tty.end);
 
@@ -3549,6 +3563,9 @@ static void do_read(struct term *term) {
 
 finish:
     screen_drain_scrolled(&term->scr);
+
+    stats_add(stats, stat_bytes_parsed, len - (term->tty.end - term->tty.start));
+    stats_end(stats, stat_read, &start);
 }
 
 HOT
@@ -3572,11 +3589,145 @@ static inline bool is_osc52_reply(struct term *term) {
     return term->paste.from;
 }
 
-void term_paste(struct term *term, uint8_t *data, ssize_t size, bool utf8, bool is_first, bool is_last) {
-    uint8_t buf1[2*PASTE_BLOCK_SIZE];
-    uint8_t buf2[4*PASTE_BLOCK_SIZE];
+/* Returns true if byte needs to be replaced or quoted when pasting */
+static inline bool is_paste_special(uint8_t ch, bool nl, bool quote, bool quote_c1) {
+    return (nl && ch == '\n') || (quote && (ch < 0x20 || ch == 0x7F || (quote_c1 && ch - 0x80U < 0x20U)));
+}
+
+static const uint8_t *find_paste_special(const uint8_t *start, const uint8_t *end, bool nl, bool quote, bool quote_c1) {
+#ifdef __SSE2__
+    const __m128i lf = _mm_set1_epi8('\n'), del = _mm_set1_epi8(0x7F);
+    const __m128i c0_max = _mm_set1_epi8(0x1F), c1_min = _mm_set1_epi8((char)0x80);
+
+    for (; end - start >= (ssize_t)sizeof(__m128i); start += sizeof(__m128i)) {
+        __m128i b = _mm_loadu_si128((const __m128i *)start);
+        __m128i special = _mm_setzero_si128();
+
+        if (nl)
+            special = _mm_cmpeq_epi8(b, lf);
+        if (quote) {
+            /* Unsigned comparison b <= 0x1F as min(b, 0x1F) == b */
+            special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(b, c0_max), b));
+            special = _mm_or_si128(special, _mm_cmpeq_epi8(b, del));
+            if (quote_c1) {
+                __m128i c1 = _mm_sub_epi8(b, c1_min);
+                special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(c1, c0_max), c1));
+            }
+        }
+
+        uint32_t mask = _mm_movemask_epi8(special);
+        if (mask) return start + __builtin_ctz(mask);
+    }
+#endif
+    while (start < end && !is_paste_special(*start, nl, quote, quote_c1)) start++;
+    return start;
+}
+
+static const uint8_t *find_non_ascii(const uint8_t *start, const uint8_t *end) {
+#ifdef __SSE2__
+    for (; end - start >= (ssize_t)sizeof(__m128i); start += sizeof(__m128i)) {
+        uint32_t mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)start));
+        if (mask) return start + __builtin_ctz(mask);
+    }
+#endif
+    while (start < end && *start < 0x80) start++;
+    return start;
+}
+
+static inline uint8_t *copy_run(uint8_t *dst, const uint8_t *src, const uint8_t *end) {
+    memcpy(dst, src, end - src);
+    return dst + (end - src);
+}
+
+/* Converts pasted text from UTF-8 to 8-bit encoding and back.
+ * Incomplete UTF-8 sequence at the end of the block is kept
+ * until the next block arrives */
+static uint8_t *paste_convert(struct term *term, uint8_t *dst, const uint8_t *src, const uint8_t *end, bool from_utf8, bool is_last) {
+    if (!from_utf8) {
+        while (src < end) {
+            const uint8_t *next = find_non_ascii(src, end);
+            dst = copy_run(dst, src, next);
+            if ((src = next) < end)
+                dst += utf8_encode(*src++, dst, dst + UTF8_MAX_LEN);
+        }
+        return dst;
+    }
+
+    uint32_t ch;
+    if (term->paste.partial_len) {
+        uint8_t tmp[2*UTF8_MAX_LEN];
+        size_t plen = term->paste.partial_len;
+        size_t len = MIN(sizeof tmp - plen, (size_t)(end - src));
+        memcpy(tmp, term->paste.partial, plen);
+        memcpy(tmp + plen, src, len);
+
+        const uint8_t *pos = tmp, *tend = tmp + plen + len;
+        while (pos < tmp + plen && utf8_decode(&ch, &pos, tend))
+            *dst++ = ch < 0x100 ? ch : '?';
+
+        term->paste.partial_len = 0;
+        if (pos < tmp + plen) {
+            /* Still incomplete, all of the block is consumed */
+            if (is_last) *dst++ = '?';
+            else memcpy(term->paste.partial, pos, term->paste.partial_len = tend - pos);
+            return dst;
+        }
+        src += pos - (tmp + plen);
+    }
+
+    while (src < end) {
+        const uint8_t *next = find_non_ascii(src, end);
+        dst = copy_run(dst, src, next);
+        if ((src = next) >= end) break;
+
+        if (!utf8_decode(&ch, &src, end)) {
+            if (is_last) *dst++ = '?';
+            else memcpy(term->paste.partial, src, term->paste.partial_len = end - src);
+            break;
+        }
+        *dst++ = ch < 0x100 ? ch : '?';
+    }
+
+    return dst;
+}
+
+static uint8_t *paste_quote(uint8_t *dst, const uint8_t *src, const uint8_t *end, bool nl, bool quote, bool quote_c1) {
+    while (src < end) {
+        const uint8_t *next = find_paste_special(src, end, nl, quote, quote_c1);
+        dst = copy_run(dst, src, next);
+        if ((src = next) >= end) break;
+
+        uint8_t ch = *src++;
+        if (nl && ch == '\n') ch = '\r';
+        /* Prefix control symbols with Ctrl-V */
+        if (is_paste_special(ch, false, quote, quote_c1))
+            *dst++ = 0x16;
+        *dst++ = ch;
+    }
+    return dst;
+}
+
+/* Encodes complete 3-byte groups, the rest is kept for the next block */
+static uint8_t *paste_base64(struct term *term, uint8_t *dst, const uint8_t *src, const uint8_t *end) {
+    while (term->paste.leftover_len && term->paste.leftover_len < 3 && src < end)
+        term->paste.leftover[term->paste.leftover_len++] = *src++;
 
-    assert(size <= PASTE_BLOCK_SIZE);
+    if (term->paste.leftover_len == 3) {
+        dst = base64_encode(dst, term->paste.leftover, term->paste.leftover + 3);
+        term->paste.leftover_len = 0;
+    }
+
+    size_t tail = (end - src) % 3;
+    dst = base64_encode(dst, src, end - tail);
+    memcpy(term->paste.leftover + term->paste.leftover_len, end - tail, tail);
+    term->paste.leftover_len += tail;
+    return dst;
+}
+
+void term_paste(struct term *term, const uint8_t *data, size_t size, bool utf8, bool is_first, bool is_last) {
+    /* Conversion to UTF-8 and quoting can both double the size */
+    uint8_t buf1[3*PASTE_BLOCK_SIZE];
+    uint8_t buf2[4*PASTE_BLOCK_SIZE + 2*UTF8_MAX_LEN];
 
     /* There's a race condition
      * if user have requested paste and
@@ -3590,14 +3741,13 @@ void term_paste(struct term *term, uint8_t *data, ssize_t size, bool utf8, bool
      * rather rare to deal with
      */
 
-    uint8_t *pos = data, *end = data + size;
-
     if (is_first) {
         term->paste.quote = term->mode.paste_quote;
         term->paste.bracketed = term->mode.bracketed_paste;
         term->paste.utf8 = term->mode.utf8;
         term->paste.literal_nl = term->mode.paste_literal_nl;
         term->paste.leftover_len = 0;
+        term->paste.partial_len = 0;
         if (is_osc52_reply(term)) {
             term_answerback(term, OSC"52;%c;", term->paste.from);
         } else if (term->paste.bracketed) {
@@ -3605,59 +3755,48 @@ void term_paste(struct term *term, uint8_t *data, ssize_t size, bool utf8, bool
         }
     }
 
-    if (size) {
-        if (!term->paste.literal_nl)
-            while ((pos = memchr(pos, '\n', end - pos))) *pos = '\r';
+    bool convert = utf8 ^ term->paste.utf8, nl = !term->paste.literal_nl;
+    bool quote = term->paste.quote && !is_osc52_reply(term), quote_c1 = !term_is_utf8_enabled(term);
 
-        if (utf8 ^ term->paste.utf8) {
-            pos = data;
-            size = 0;
-            if (utf8) {
-                uint32_t ch;
-                while (pos < end)
-                    if (utf8_decode(&ch, (const uint8_t **)&pos, end))
-                        buf1[size++] = ch;
-            } else {
-                while (pos < end)
-                    size += utf8_encode(*pos++, buf1 + size, buf1 + LEN(buf1));
-            }
+    /* Data is processed in blocks, so arbitrarily large pastes
+     * don't need any memory besides the PTY write queue */
+    do {
+        size_t len = MIN(size, PASTE_BLOCK_SIZE);
+        const uint8_t *block = data, *end = data + len;
+        data += len;
+        size -= len;
 
-            data = buf1;
+        /* Incomplete UTF-8 sequence is flushed with the last block */
+        if (!len && !(is_last && term->paste.partial_len)) break;
+
+        if (convert) {
+            end = paste_convert(term, buf1, block, end, utf8, is_last && !size);
+            block = buf1;
         }
 
-        if (is_osc52_reply(term)) {
-            while (term->paste.leftover_len < 3 && size) term->paste.leftover[term->paste.leftover_len++] = *data++, size--;
-            size_t pre = base64_encode(buf2, term->paste.leftover, term->paste.leftover + term->paste.leftover_len) - buf2;
-
-            if (size) {
-                if (!is_last) {
-                    term->paste.leftover_len = size % 3;
-                    if (term->paste.leftover_len > 0) term->paste.leftover[0] = data[size - term->paste.leftover_len], size--;
-                    if (term->paste.leftover_len > 1) term->paste.leftover[1] = data[size - 1], size--;
-                }
+        if (nl || quote) {
+            end = paste_quote(buf2, block, end, nl, quote, quote_c1);
+            block = buf2;
+        }
 
-                size = base64_encode(buf2 + pre, data, data + size) - buf2;
-            }
-            data = buf2;
-        } else if (term->paste.quote) {
-            bool quote_c1 = !term_is_utf8_enabled(term);
-            ssize_t i = 0, j = 0;
-            while (i < size) {
-                /* Prefix control symbols with Ctrl-V */
-                if (buf1[i] < 0x20 || buf1[i] == 0x7F ||
-                        (quote_c1 && buf1[i] > 0x7F && buf1[i] < 0xA0))
-                    buf2[j++] = 0x16;
-                buf2[j++] = buf1[i++];
-            }
-            size = j;
-            data = buf2;
+        if (is_osc52_reply(term)) {
+            uint8_t *dst = block == buf1 ? buf2 : buf1;
+            end = paste_base64(term, dst, block, end);
+            block = dst;
         }
 
-        term_sendkey(term, data, size);
-    }
+        if (end > block)
+            term_sendkey(term, block, end - block);
+    } while (size);
 
     if (is_last) {
         if (is_osc52_reply(term)) {
+            if (term->paste.leftover_len) {
+                uint8_t *end = base64_encode(buf1, term->paste.leftover,
+                                             term->paste.leftover + term->paste.leftover_len);
+                term_sendkey(term, buf1, end - buf1);
+                term->paste.leftover_len = 0;
+            }
             term_answerback(term, ST);
             term->paste.from = 0;
         } else if (term->paste.bracketed) {
@@ -3678,6 +3817,10 @@ bool term_is_utf8_enabled(struct term *term) {
     return term->mode.utf8;
 }
 
+bool term_is_write_congested(struct term *term) {
+    return tty_is_congested(&term->tty);
+}
+
 bool term_is_nrcs_enabled(struct term *term) {
     return term->mode.enable_nrcs;
 }
@@ -3849,6 +3992,9 @@ void term_sendkey(struct term *term, const uint8_t *str, size_t len) {
     }
 
     tty_write(&term->tty, encode ? rep : str, len, term->mode.crlf);
+
+    if (UNLIKELY(gconfig.trace_latency))
+        window_trace_latency(screen_window(&term->scr), latency_written);
 }
 
 bool term_is_requested_resize(struct term *term) {
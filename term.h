@@ -62,7 +62,7 @@ struct selection_state *term_get_sstate(struct term *term);
 struct window *term_window(struct term *term);
 color_t *term_palette(struct term *term);
 int term_fd(struct term *term);
-void term_paste(struct term *term, uint8_t *data, ssize_t size, bool utf8, bool is_first, bool is_last);
+void term_paste(struct term *term, const uint8_t *data, size_t size, bool utf8, bool is_first, bool is_last);
 void term_sendkey(struct term *term, const uint8_t *data, size_t size);
 void term_answerback(struct term *term, const char *str, ...) __attribute__ ((format (printf, 2, 3)));
 void term_reset(struct term *term);
@@ -89,13 +89,17 @@ void screen_damage_selection(struct screen *scr);
 void screen_damage_uri(struct screen *scr, uint32_t uri);
 #endif
 
-/* Needs to be multiple of 4 */
-#define PASTE_BLOCK_SIZE 1024
+/* Pasted data is converted in blocks of this size */
+#define PASTE_BLOCK_SIZE 4096
+/* Clipboard data is read in pieces of this size,
+ * needs to be multiple of 4 */
+#define PASTE_READ_SIZE (64 << 10)
 
 bool term_is_keep_clipboard_enabled(struct term *term);
 bool term_is_bell_urgent_enabled(struct term *term);
 bool term_is_bell_raise_enabled(struct term *term);
 bool term_is_utf8_enabled(struct term *term);
+bool term_is_write_congested(struct term *term);
 bool term_is_nrcs_enabled(struct term *term);
 bool term_is_reverse(struct term *term);
 void term_toggle_force_mouse_mode(struct term *term);
@@ -7,8 +7,10 @@
 
 #include "config.h"
 #include "poller.h"
+#include "stats.h"
 #include "tty.h"
 #include "util.h"
+#include "window.h"
 
 #include <errno.h>
 #include <fcntl.h>
@@ -24,6 +26,7 @@
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <termios.h>
 #include <unistd.h>
@@ -38,7 +41,13 @@
 #endif
 
 
-#define TTY_MAX_WRITE 256
+/* Write queue sizes, paste producers are paused when the queue
+ * grows above the high watermark and resumed when it drains
+ * below the low watermark */
+#define TTY_QUEUE_INIT_CAPS 4096
+#define TTY_QUEUE_KEEP_CAPS 65536
+#define TTY_QUEUE_HIGH (1 << 20)
+#define TTY_QUEUE_LOW (64 << 10)
 
 /* Head of TTYs list with alive child process */
 static struct list_head children;
@@ -366,7 +375,7 @@ void hang_watched_children(void) {
 }
 
 int tty_open(struct tty *tty, struct instance_config *cfg, struct window *win) {
-    list_init(&tty->deferred);
+    tty->win = win;
 
     /* Configure PTY */
     struct termios tio = dtio;
@@ -453,58 +462,111 @@ static void tty_toggle_write(struct tty *tty, bool enable) {
         poller_toggle(tty->evt, !!new);
 }
 
+static void free_write_queue(struct write_queue *queue) {
+    free(queue->data);
+    *queue = (struct write_queue) {0};
+}
+
 void tty_hang(struct tty *tty) {
-    remove_watcher(&tty->w);
     poller_unset(&tty->evt);
+    remove_watcher(&tty->w);
 
-    LIST_FOREACH_SAFE(it, &tty->deferred)
-        free(CONTAINEROF(it, struct deferred_write, link));
+    free_write_queue(&tty->queue);
+
+    /* Paused pastes are only resumed when the queue drains,
+     * let them finish, writes to the exited tty are discarded. */
+    if (tty->congested) {
+        tty->congested = false;
+        window_resume_paste(tty->win);
+    }
 }
 
-static void defer_write(struct tty *tty, const uint8_t *buf, ssize_t len) {
-    if (tty_exited(tty)) return;
+static void defer_write(struct tty *tty, const uint8_t *buf, size_t len) {
+    if (tty_exited(tty) || !len) return;
 
-    warn("TTY buffer is full, deferring write of %ld bytes (%ld in queue)", len, tty->deferred_count);
-    tty->deferred_count++;
+    struct write_queue *queue = &tty->queue;
 
-    if (list_empty(&tty->deferred))
+    if (!queue->size) {
+        if (gconfig.trace_misc)
+            info("TTY buffer is full, deferring write of %zu bytes", len);
         tty_toggle_write(tty, true);
+    }
+
+    if (queue->size + len > queue->caps) {
+        size_t caps = MAX(queue->caps, TTY_QUEUE_INIT_CAPS);
+        while (caps < queue->size + len) caps *= 2;
+
+        /* Unwrap the data while moving it */
+        uint8_t *data = xalloc(caps);
+        size_t first = MIN(queue->size, queue->caps - queue->head);
+        if (queue->size) {
+            memcpy(data, queue->data + queue->head, first);
+            memcpy(data + first, queue->data, queue->size - first);
+        }
+
+        free(queue->data);
+        queue->data = data;
+        queue->caps = caps;
+        queue->head = 0;
+    }
+
+    size_t tail = (queue->head + queue->size) & (queue->caps - 1);
+    size_t first = MIN(len, queue->caps - tail);
+    memcpy(queue->data + tail, buf, first);
+    memcpy(queue->data, buf + first, len - first);
+    queue->size += len;
+
+    stats_add(window_stats(tty->win), stat_bytes_deferred, len);
 
-    struct deferred_write *wr = xalloc(sizeof *wr + len);
-    list_insert_before(&tty->deferred, &wr->link);
-    wr->size = len;
-    wr->offset = 0;
-    memcpy(wr->data, buf, len);
+    if (queue->size >= TTY_QUEUE_HIGH)
+        tty->congested = true;
 }
 
+/* Returns true if the queue is empty */
 static bool flush_deferred(struct tty *tty) {
-    if (!tty->deferred_count) return true;
+    struct write_queue *queue = &tty->queue;
+    if (!queue->size) return true;
 
     errno = 0;
 
-    LIST_FOREACH_SAFE(it, &tty->deferred) {
-        struct deferred_write *wr = CONTAINEROF(it, struct deferred_write, link);
-        do {
-            ssize_t result = write(tty->w.fd, wr->data + wr->offset, MIN(wr->size - wr->offset, TTY_MAX_WRITE));
-            if (result <= 0) {
-                if (result == 0 || errno == EAGAIN)
-                    return false;
-
-                warn("TTY write failed: %s", strerror(errno));
-                tty_hang(tty);
-                return false;
+    bool done = true;
+    while (queue->size) {
+        size_t first = MIN(queue->size, queue->caps - queue->head);
+        struct iovec iov[2] = {
+            { .iov_base = queue->data + queue->head, .iov_len = first },
+            { .iov_base = queue->data, .iov_len = queue->size - first },
+        };
+
+        ssize_t result = writev(tty->w.fd, iov, 1 + (first < queue->size));
+        if (result <= 0) {
+            if (result == 0 || errno == EAGAIN) {
+                done = false;
+                break;
             }
 
-            wr->offset += result;
-        } while (wr->size != wr->offset);
-        tty->deferred_count--;
-        list_remove(it);
-        free(wr);
+            warn("TTY write failed: %s", strerror(errno));
+            tty_hang(tty);
+            return false;
+        }
+
+        queue->head = (queue->head + result) & (queue->caps - 1);
+        queue->size -= result;
     }
 
-    if (list_empty(&tty->deferred))
+    if (done) {
         tty_toggle_write(tty, false);
-    return true;
+        queue->head = 0;
+        /* Don't keep large buffers after pastes */
+        if (queue->caps > TTY_QUEUE_KEEP_CAPS)
+            free_write_queue(queue);
+    }
+
+    if (tty->congested && queue->size <= TTY_QUEUE_LOW) {
+        tty->congested = false;
+        window_resume_paste(tty->win);
+    }
+
+    return done;
 }
 
 static ssize_t compact_buffer(struct tty *tty) {
@@ -563,14 +625,16 @@ ssize_t tty_refill(struct tty *tty) {
 }
 
 static inline void tty_write_raw(struct tty *tty, const uint8_t *buf, ssize_t len) {
-    if (!flush_deferred(tty)) {
+    /* Queued data is written first, new data is coalesced
+     * with it and written when the PTY becomes writable */
+    if (tty->queue.size) {
         defer_write(tty, buf, len);
         return;
     }
 
     errno = 0;
-    do {
-        ssize_t result = write(tty->w.fd, buf, MIN(len, TTY_MAX_WRITE));
+    while (len) {
+        ssize_t result = write(tty->w.fd, buf, len);
         if (result <= 0) {
             if (result == 0 || errno == EAGAIN) {
                 defer_write(tty, buf, len);
@@ -584,7 +648,7 @@ static inline void tty_write_raw(struct tty *tty, const uint8_t *buf, ssize_t le
 
         len -= result;
         buf += result;
-    } while (len);
+    }
 }
 
 void tty_write(struct tty *tty, const uint8_t *buf, size_t len, bool crlf) {
@@ -39,18 +39,23 @@ struct printer {
     bool print_controller;
 };
 
-struct deferred_write {
-    struct list_head link;
-    ssize_t offset;
-    ssize_t size;
-    char data[];
+/* Ring buffer of data that could not be written
+ * to the PTY yet, its capacity is a power of two */
+struct write_queue {
+    uint8_t *data;
+    size_t caps;
+    size_t head;
+    size_t size;
 };
 
 struct tty {
     struct watcher w;
-    struct list_head deferred;
+    struct write_queue queue;
     struct event *evt;
-    ssize_t deferred_count;
+    struct window *win;
+    /* Write queue is above the high watermark and
+     * did not drain below the low watermark yet */
+    bool congested;
 
     uint8_t fd_buf[FD_BUF_SIZE];
     uint8_t *start;
@@ -65,6 +70,10 @@ static inline bool tty_exited(struct tty *tty) {
     return tty->w.child < 0;
 }
 
+static inline bool tty_is_congested(struct tty *tty) {
+    return tty->congested;
+}
+
 void init_default_termios(void);
 void hang_watched_children(void);
 
@@ -0,0 +1,219 @@
+/* Copyright (c) 2026, Evgeniy Baskov. All rights reserved */
+
+#include "feature.h"
+
+#include "config.h"
+#include "util.h"
+#include "window-impl.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Detached windows use this backend: terminal keeps running and
+ * parsing output, but nothing is displayed, so all the display
+ * and renderer resources can be freed. Only the state that needs
+ * to be restored when the window is attached again is kept. */
+
+struct platform_window {
+    char *title;
+    char *icon_label;
+    bool title_utf8;
+    bool icon_label_utf8;
+    struct extent position;
+} ALIGNED(MALLOC_ALIGNMENT);
+
+static inline struct platform_window *get_plat(struct window *win) {
+    return (struct platform_window *)win->platform_window_opaque;
+}
+
+static void headless_update(struct window *win, struct rect rect) {
+    (void)win, (void)rect;
+}
+
+static bool headless_reload_font(struct window *win, bool need_free) {
+    /* New font is loaded when the window is attached */
+    (void)win, (void)need_free;
+    return true;
+}
+
+static void headless_reload_cursors(struct window *win) {
+    (void)win;
+}
+
+static void headless_resize(struct window *win, int16_t new_w, int16_t new_h, int16_t new_cw, int16_t new_ch, bool artificial) {
+    (void)win, (void)new_w, (void)new_h, (void)new_cw, (void)new_ch, (void)artificial;
+}
+
+static void headless_copy(struct window *win, struct rect dst, int16_t sx, int16_t sy) {
+    (void)win, (void)dst, (void)sx, (void)sy;
+}
+
+static bool headless_submit_screen(struct window *win, int16_t cur_x, ssize_t cur_y, bool cursor_visible, bool marg) {
+    (void)win, (void)cur_x, (void)cur_y, (void)cursor_visible, (void)marg;
+    return false;
+}
+
+static struct extent headless_get_screen_size(struct window *win) {
+    return win->w;
+}
+
+static bool headless_has_error(void) {
+    return false;
+}
+
+static ssize_t headless_get_opaque_size(void) {
+    return sizeof(struct platform_window);
+}
+
+static void headless_flush(void) {
+}
+
+static struct extent headless_get_position(struct window *win) {
+    return get_plat(win)->position;
+}
+
+static bool headless_init_window(struct window *win) {
+    memset(get_plat(win), 0, sizeof(struct platform_window));
+    win->mapped = false;
+    win->focused = false;
+    return true;
+}
+
+static void headless_free_window(struct window *win) {
+    free(get_plat(win)->title);
+    free(get_plat(win)->icon_label);
+    memset(get_plat(win), 0, sizeof(struct platform_window));
+}
+
+static bool headless_set_clip(struct window *win, enum clip_target target) {
+    (void)win, (void)target;
+    return false;
+}
+
+static void headless_bell(struct window *win, uint8_t vol) {
+    (void)win, (void)vol;
+}
+
+static void headless_enable_mouse_events(struct window *win, bool enabled) {
+    (void)win, (void)enabled;
+}
+
+static void headless_get_pointer(struct window *win, struct extent *ext, int32_t *mask) {
+    (void)win;
+    *ext = (struct extent) {0, 0};
+    *mask = 0;
+}
+
+static void headless_get_title(struct window *win, enum title_target which, char **name, bool *utf8) {
+    const char *data = NULL;
+    if (which & target_title) {
+        data = get_plat(win)->title;
+        if (utf8) *utf8 = get_plat(win)->title_utf8;
+    } else if (which & target_icon_label) {
+        data = get_plat(win)->icon_label;
+        if (utf8) *utf8 = get_plat(win)->icon_label_utf8;
+    }
+    if (name) *name = data ? strdup(data) : NULL;
+}
+
+static void headless_map_window(struct window *win) {
+    (void)win;
+}
+
+static void headless_move_window(struct window *win, int16_t x, int16_t y) {
+    get_plat(win)->position = (struct extent) {x, y};
+}
+
+static void headless_paste(struct window *win, enum clip_target target) {
+    (void)win, (void)target;
+}
+
+static bool headless_resize_window(struct window *win, int16_t width, int16_t height) {
+    (void)win, (void)width, (void)height;
+    return false;
+}
+
+static void headless_set_icon_label(struct window *win, const char *title, bool utf8) {
+    free(get_plat(win)->icon_label);
+    get_plat(win)->icon_label = title ? strdup(title) : NULL;
+    get_plat(win)->icon_label_utf8 = utf8;
+}
+
+static void headless_set_title(struct window *win, const char *title, bool utf8) {
+    free(get_plat(win)->title);
+    get_plat(win)->title = title ? strdup(title) : NULL;
+    get_plat(win)->title_utf8 = utf8;
+}
+
+static void headless_set_urgency(struct window *win, bool set) {
+    (void)win, (void)set;
+}
+
+static void headless_update_colors(struct window *win) {
+    (void)win;
+}
+
+static bool headless_window_action(struct window *win, enum window_action action) {
+    (void)win, (void)action;
+    return false;
+}
+
+static void headless_update_props(struct window *win) {
+    (void)win;
+}
+
+static void headless_apply_geometry(struct window *win, struct geometry *geometry) {
+    (void)win, (void)geometry;
+}
+
+static void headless_select_cursor(struct window *win, const char *name) {
+    (void)win, (void)name;
+}
+
+static bool headless_try_update_pointer_mode(struct window *win, bool hide) {
+    (void)win, (void)hide;
+    return true;
+}
+
+static void headless_free(void) {
+}
+
+static struct platform_vtable headless_vtable = {
+    .update = headless_update,
+    .reload_font = headless_reload_font,
+    .reload_cursors = headless_reload_cursors,
+    .resize = headless_resize,
+    .copy = headless_copy,
+    .submit_screen = headless_submit_screen,
+    .get_screen_size = headless_get_screen_size,
+    .has_error = headless_has_error,
+    .get_opaque_size = headless_get_opaque_size,
+    .flush = headless_flush,
+    .get_position = headless_get_position,
+    .init_window = headless_init_window,
+    .free_window = headless_free_window,
+    .set_clip = headless_set_clip,
+    .bell = headless_bell,
+    .enable_mouse_events = headless_enable_mouse_events,
+    .get_pointer = headless_get_pointer,
+    .get_title = headless_get_title,
+    .map_window = headless_map_window,
+    .move_window = headless_move_window,
+    .paste = headless_paste,
+    .resize_window = headless_resize_window,
+    .set_icon_label = headless_set_icon_label,
+    .set_title = headless_set_title,
+    .set_urgency = headless_set_urgency,
+    .update_colors = headless_update_colors,
+    .window_action = headless_window_action,
+    .update_props = headless_update_props,
+    .apply_geometry = headless_apply_geometry,
+    .select_cursor = headless_select_cursor,
+    .try_update_pointer_mode = headless_try_update_pointer_mode,
+    .free = headless_free,
+};
+
+const struct platform_vtable *platform_init_headless(void) {
+    return &headless_vtable;
+}
@@ -13,6 +13,8 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <string.h>
+#include <time.h>
 #include <xkbcommon/xkbcommon.h>
 
 #define NSST_CLASS "Nsst"
@@ -37,8 +39,26 @@ struct title_stack_item {
     char data[];
 };
 
+/* Must be a power of 2 */
+#define COLOR_MEMO_SIZE 64
+
+/* Resolved colors of an attribute. Entries are only valid
+ * during the frame with the same generation number */
+struct color_memo_entry {
+    struct attr attr;
+    color_t fg;
+    color_t bg;
+    color_t ul;
+    /* Attribute mask after special colors were applied */
+    uint32_t mask;
+    uint32_t generation;
+    bool selected;
+};
+
 struct render_cell_state {
     color_t *palette;
+    uint32_t memo_generation;
+    struct color_memo_entry memo[COLOR_MEMO_SIZE];
     uint32_t active_uri : 23;
     uint32_t dummy_ : 7;
     bool blink : 1;
@@ -57,6 +77,8 @@ struct platform_shm {
 
 struct window {
     struct list_head link;
+    /* Unique within the process, reported to nsstc */
+    uint32_t id;
 
     bool focused : 1;
     bool mouse_events : 1;
@@ -68,12 +90,31 @@ struct window {
     bool redraw_borders : 1;
     bool force_redraw : 1;
     bool mapped : 1;
+    /* Window is mapped but cannot be seen */
+    bool obscured : 1;
+    /* Presentation feedback was not received in time,
+     * frames are paced by timer until it arrives */
+    bool frame_stalled : 1;
+    /* Frame timer waits for the feedback of the last submitted frame,
+     * other feedback is stale, e.g. requested while stalled */
+    bool frame_feedback_pending : 1;
     bool pointer_is_hidden : 1;
     bool pointer_inhibit : 1;
+    /* Blinking state changed, only cursor and
+     * blinking cells need to be repainted */
+    bool blink_damaged : 1;
+    /* Current redraw only visits rows returned by row_needs_redraw() */
+    bool partial_redraw : 1;
 
     int16_t damaged_y0;
     int16_t damaged_y1;
 
+    /* Rows that contained blinking cells when they were
+     * last redrawn, these are maintained by renderers */
+    bool *blink_rows;
+    size_t blink_rows_caps;
+    ssize_t last_cursor_row;
+
     struct event *frame_timer;
     struct event *smooth_scroll_timer;
     struct event *blink_timer;
@@ -87,6 +128,22 @@ struct window {
     int inhibit_render_counter;
     int inhibit_read_counter;
 
+    /* Remaining parsing and rendering time for this loop iteration, see charge_window_time() */
+    int64_t read_credit;
+    bool read_throttled;
+
+    /* Time of the last frame submission with
+     * feedback and smoothed latency until the next vblank */
+    struct timespec frame_submit_time;
+    int64_t vblank_latency;
+
+    struct stats stats;
+
+    /* Timestamps of the traced key press stages */
+    struct timespec latency_stamps[latency_MAX];
+    enum latency_stage latency_stage;
+    bool latency_pending;
+
     color_t bg;
     color_t bg_premul;
     color_t cursor_fg;
@@ -101,6 +158,8 @@ struct window {
     int16_t char_height;
     struct font *font;
     struct glyph_cache *font_cache;
+    /* Registry entry owning font and font_cache */
+    struct shared_cache *shared_cache;
     struct glyph *undercurl_glyph;
     enum pixel_mode font_pixmode;
     enum hide_pointer_mode pointer_mode;
@@ -113,35 +172,52 @@ struct window {
     /* Window configuration */
     struct instance_config cfg;
 
+    /* Platform backend of the window, headless while it is detached */
+    const struct platform_vtable *vtbl;
+
     char platform_window_opaque[] ALIGNED(MALLOC_ALIGNMENT);
 } ALIGNED(MALLOC_ALIGNMENT);
 
 extern struct list_head win_list_head;
 extern const struct platform_vtable *pvtbl;
 
-FORCEINLINE
-static inline struct cellspec describe_cell(struct cell cell, struct attr *attr, struct instance_config *cfg, struct render_cell_state *rcs, bool selected, bool slow_path) {
-    struct cellspec res = {0};
-#if USE_URI
-    bool has_uri = attr->uri && cfg->uri_mode != uri_mode_off;
-    bool active_uri = attr->uri == rcs->active_uri;
-#else
-    bool has_uri = 0, active_uri = 0;
-#endif
+static inline void prepare_blink_rows(struct window *win) {
+    adjust_buffer((void **)&win->blink_rows, &win->blink_rows_caps, win->c.height, sizeof *win->blink_rows);
+}
+
+static inline bool row_needs_redraw(struct window *win, ssize_t row, ssize_t cur_y) {
+    return !win->partial_redraw || row == cur_y || row == win->last_cursor_row || win->blink_rows[row];
+}
+
+/* Palette, blinking phase and configuration do not change while
+ * a frame is drawn, so resolved colors are cached until the next one */
+static inline void color_memo_reset(struct render_cell_state *rcs) {
+    if (UNLIKELY(!++rcs->memo_generation)) {
+        memset(rcs->memo, 0, sizeof rcs->memo);
+        rcs->memo_generation = 1;
+    }
+}
+
+static inline struct color_memo_entry *color_memo_slot(struct render_cell_state *rcs, struct attr *attr, bool selected) {
+    uint64_t key = attr->mask64[0] ^ ((attr->mask64[1] & ~PROTECTED_MASK64) + selected)*UINT64_C(0x9E3779B97F4A7C15);
+    return &rcs->memo[(key * UINT64_C(0x9E3779B97F4A7C15)) >> (64 - __builtin_ctz(COLOR_MEMO_SIZE))];
+}
 
+FORCEINLINE
+static inline void resolve_colors(struct cellspec *res, struct attr *attr, struct instance_config *cfg, struct render_cell_state *rcs, bool selected, bool slow_path, bool has_uri, bool active_uri) {
     if (LIKELY(!slow_path && !has_uri)) {
         /* Calculate colors */
         if (attr->bold && !attr->faint && color_idx(attr->fg) < 8) attr->fg = indirect_color(color_idx(attr->fg) + 8);
-        res.bg = direct_color(attr->bg, rcs->palette);
-        res.fg = direct_color(attr->fg, rcs->palette);
-        if (!attr->bold && attr->faint) res.fg = (res.fg & 0xFF000000) | ((res.fg & 0xFEFEFE) >> 1);
-        if (attr->reverse) SWAP(res.fg, res.bg);
+        res->bg = direct_color(attr->bg, rcs->palette);
+        res->fg = direct_color(attr->fg, rcs->palette);
+        if (!attr->bold && attr->faint) res->fg = (res->fg & 0xFF000000) | ((res->fg & 0xFEFEFE) >> 1);
+        if (attr->reverse) SWAP(res->fg, res->bg);
 
-        res.ul = attr->ul != indirect_color(SPECIAL_BG) ? direct_color(attr->ul, rcs->palette) : res.fg;
+        res->ul = attr->ul != indirect_color(SPECIAL_BG) ? direct_color(attr->ul, rcs->palette) : res->fg;
 
         /* Apply background opacity */
-        if (color_idx(attr->bg) == SPECIAL_BG) res.bg = color_apply_a(res.bg, cfg->alpha);
-        if (attr->invisible || (attr->blink && rcs->blink)) res.ul = res.fg = res.bg;
+        if (color_idx(attr->bg) == SPECIAL_BG) res->bg = color_apply_a(res->bg, cfg->alpha);
+        if (attr->invisible || (attr->blink && rcs->blink)) res->ul = res->fg = res->bg;
 
     } else {
         /* Check special colors */
@@ -158,39 +234,72 @@ static inline struct cellspec describe_cell(struct cell cell, struct attr *attr,
 
         /* Calculate colors */
         if (attr->bold && !attr->faint && color_idx(attr->fg) < 8) attr->fg = indirect_color(color_idx(attr->fg) + 8);
-        res.bg = direct_color(attr->bg, rcs->palette);
-        res.fg = direct_color(attr->fg, rcs->palette);
-        if (!attr->bold && attr->faint) res.fg = (res.fg & 0xFF000000) | ((res.fg & 0xFEFEFE) >> 1);
-        if (attr->reverse ^ selected ^ (has_uri && active_uri && rcs->uri_pressed)) SWAP(res.fg, res.bg);
+        res->bg = direct_color(attr->bg, rcs->palette);
+        res->fg = direct_color(attr->fg, rcs->palette);
+        if (!attr->bold && attr->faint) res->fg = (res->fg & 0xFF000000) | ((res->fg & 0xFEFEFE) >> 1);
+        if (attr->reverse ^ selected ^ (has_uri && active_uri && rcs->uri_pressed)) SWAP(res->fg, res->bg);
 
-        res.ul = attr->ul != indirect_color(SPECIAL_BG) ? direct_color(attr->ul, rcs->palette) : res.fg;
+        res->ul = attr->ul != indirect_color(SPECIAL_BG) ? direct_color(attr->ul, rcs->palette) : res->fg;
 
         /* Apply background opacity */
-        if (color_idx(attr->bg) == SPECIAL_BG || cfg->blend_all_bg) res.bg = color_apply_a(res.bg, cfg->alpha);
+        if (color_idx(attr->bg) == SPECIAL_BG || cfg->blend_all_bg) res->bg = color_apply_a(res->bg, cfg->alpha);
         if (UNLIKELY(cfg->blend_fg)) {
-            res.fg = color_apply_a(res.fg, cfg->alpha);
-            res.ul = color_apply_a(res.ul, cfg->alpha);
+            res->fg = color_apply_a(res->fg, cfg->alpha);
+            res->ul = color_apply_a(res->ul, cfg->alpha);
         }
 
-        if ((!selected && attr->invisible) || (attr->blink && rcs->blink)) res.ul = res.fg = res.bg;
+        if ((!selected && attr->invisible) || (attr->blink && rcs->blink)) res->ul = res->fg = res->bg;
 
         /* If selected colors are set use them */
 
         if (selected) {
-            if (rcs->palette[SPECIAL_SELECTED_BG]) res.bg = rcs->palette[SPECIAL_SELECTED_BG];
-            if (rcs->palette[SPECIAL_SELECTED_FG]) res.fg = rcs->palette[SPECIAL_SELECTED_FG];
+            if (rcs->palette[SPECIAL_SELECTED_BG]) res->bg = rcs->palette[SPECIAL_SELECTED_BG];
+            if (rcs->palette[SPECIAL_SELECTED_FG]) res->fg = rcs->palette[SPECIAL_SELECTED_FG];
         }
 
         if (UNLIKELY(has_uri)) {
             if (rcs->palette[SPECIAL_URI_TEXT])
-                res.fg = rcs->palette[SPECIAL_URI_TEXT];
+                res->fg = rcs->palette[SPECIAL_URI_TEXT];
             if (active_uri) {
                 if (rcs->palette[SPECIAL_URI_UNDERLINE])
-                    res.ul = rcs->palette[SPECIAL_URI_UNDERLINE];
-                res.underlined = true;
+                    res->ul = rcs->palette[SPECIAL_URI_UNDERLINE];
+                res->underlined = true;
             }
         }
     }
+}
+
+FORCEINLINE
+static inline struct cellspec describe_cell(struct cell cell, struct attr *attr, struct instance_config *cfg, struct render_cell_state *rcs, bool selected, bool slow_path) {
+    struct cellspec res = {0};
+#if USE_URI
+    bool has_uri = attr->uri && cfg->uri_mode != uri_mode_off;
+    bool active_uri = attr->uri == rcs->active_uri;
+#else
+    bool has_uri = 0, active_uri = 0;
+#endif
+
+    /* Cells with URIs depend on pointer state and are not cached */
+    if (UNLIKELY(has_uri)) {
+        resolve_colors(&res, attr, cfg, rcs, selected, slow_path, has_uri, active_uri);
+    } else {
+        struct color_memo_entry *memo = color_memo_slot(rcs, attr, selected);
+        if (LIKELY(memo->generation == rcs->memo_generation && memo->selected == selected && attr_eq(&memo->attr, attr))) {
+            res.fg = memo->fg;
+            res.bg = memo->bg;
+            res.ul = memo->ul;
+            attr->mask = memo->mask;
+        } else {
+            memo->attr = *attr;
+            memo->selected = selected;
+            memo->generation = rcs->memo_generation;
+            resolve_colors(&res, attr, cfg, rcs, selected, slow_path, has_uri, active_uri);
+            memo->fg = res.fg;
+            memo->bg = res.bg;
+            memo->ul = res.ul;
+            memo->mask = attr->mask;
+        }
+    }
 
     /* Optimize rendering of U+2588 FULL BLOCK */
     if (cell.ch == 0x2588) res.bg = res.fg;
@@ -346,6 +455,7 @@ static inline struct extent win_derive_window_size(struct window *win, int16_t c
 
 const struct platform_vtable *platform_init_x11(struct instance_config *cfg);
 const struct platform_vtable *platform_init_wayland(struct instance_config *cfg);
+const struct platform_vtable *platform_init_headless(void);
 
 struct platform_vtable {
     /* Renderer dependent functions */
@@ -364,6 +474,10 @@ struct platform_vtable {
     bool (*has_error)(void);
     ssize_t (*get_opaque_size)(void);
     void (*flush)(void);
+    /* Request notification at the next display refresh after the
+     * submitted frame, window_frame_presented() should be called then.
+     * This only estimates when the frame was actually displayed */
+    bool (*request_frame)(struct window *win);
 
     struct extent (*get_position)(struct window *win);
     bool (*init_window)(struct window *win);
@@ -377,6 +491,8 @@ struct platform_vtable {
     void (*map_window)(struct window *win);
     void (*move_window)(struct window *win, int16_t x, int16_t y);
     void (*paste)(struct window *win, enum clip_target target);
+    /* Continue pastes paused because the terminal could not keep up */
+    void (*resume_paste)(struct window *win);
     bool (*resize_window)(struct window *win, int16_t width, int16_t height);
     void (*set_icon_label)(struct window *win, const char *title, bool utf8);
     void (*set_title)(struct window *win, const char *title, bool utf8);
@@ -400,6 +516,12 @@ void handle_focus(struct window *win, bool focused);
 void handle_keydown(struct window *win, struct xkb_state *state, xkb_keycode_t keycode);
 /* mouse event handler is defined elsewhere */
 
+void window_set_mapped(struct window *win, bool mapped);
+/* Closes the window or detaches it with --detach-on-close */
+void window_close(struct window *win);
+void window_set_obscured(struct window *win, bool obscured);
+void window_frame_submitted(struct window *win);
+void window_frame_presented(struct window *win, struct timespec *when);
 void window_update_pointer_mode(struct window *win);
 void window_reset_pointer_inhibit_timer(struct window *win);
 struct window *window_find_shared_font(struct window *win, bool need_free, bool force_aligned);
@@ -1,4 +1,4 @@
-/* Copyright (c) 2024-2025, Evgeniy Baskov. All rights reserved */
+/* Copyright (c) 2024-2026, Evgeniy Baskov. All rights reserved */
 
 #include "feature.h"
 
@@ -554,8 +554,9 @@ void handle_xdg_toplevel_configure(void *data, struct xdg_toplevel *xdg_toplevel
     if (height) get_plat(win)->pending_configure.height = height;
     if (width) get_plat(win)->pending_configure.width = width;
     win->any_event_happened = true;
-    win->mapped = true;
+    window_set_mapped(win, true);
 
+    bool suspended = false;
     uint32_t states_mask = 0;
     enum xdg_toplevel_state *it;
     wl_array_for_each(it, states) {
@@ -571,7 +572,7 @@ void handle_xdg_toplevel_configure(void *data, struct xdg_toplevel *xdg_toplevel
             // FIXME Should we treat is as win->focused? Probably not
             break;
         case XDG_TOPLEVEL_STATE_SUSPENDED:
-            win->mapped = false;
+            suspended = true;
             break;
         case XDG_TOPLEVEL_STATE_RESIZING:
             get_plat(win)->is_resizing = true;
@@ -587,6 +588,8 @@ void handle_xdg_toplevel_configure(void *data, struct xdg_toplevel *xdg_toplevel
         }
     }
 
+    window_set_obscured(win, suspended);
+
     if (gconfig.trace_events)
         info("Event[%p]: xdg_toplevel.configure(width=%d, height=%d, mask=%x)", data, width, height, states_mask);
 
@@ -599,7 +602,7 @@ void handle_xdg_toplevel_close(void *data, struct xdg_toplevel *xdg_toplevel) {
     if (gconfig.trace_events)
         info("Event[%p]: xdg_toplevel.close", data);
 
-   free_window(win);
+   window_close(win);
 }
 
 void handle_xdg_toplevel_configure_bounds(void *data, struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height) {
@@ -771,6 +774,8 @@ static void wayland_free_window(struct window *win) {
         wl_surface_destroy(get_plat(win)->surface);
     if (get_plat(win)->frame_callback)
         wl_callback_destroy(get_plat(win)->frame_callback);
+    if (get_plat(win)->frame_inhibit)
+        win->inhibit_render_counter--;
 
     if (get_plat(win)->title)
         free(get_plat(win)->title);
@@ -1192,7 +1197,7 @@ static bool wayland_set_clip(struct window *win, enum clip_target target) {
 }
 
 static bool do_paste_chunk(struct active_paste *paste) {
-    uint8_t buf[4096+1];
+    uint8_t buf[PASTE_READ_SIZE+1];
     ssize_t n = read(paste->fd, buf, sizeof buf - 1);
     ssize_t n2 = n;
 
@@ -1207,7 +1212,7 @@ static bool do_paste_chunk(struct active_paste *paste) {
     bool done = (n2 == 0 || (n2 < 0 && errno != EINTR));
 
     if (paste->tail || n)
-        term_paste(paste->wptr.win->term, buf, n, paste->utf8, false, done);
+        term_paste(paste->wptr.win->term, buf, n, paste->utf8, !paste->tail, done);
 
     paste->tail = true;
     return done;
@@ -1218,6 +1223,16 @@ static void handle_paste(void *paste_, uint32_t mask) {
     (void)mask;
     if (do_paste_chunk(paste))
         free_paste(paste);
+    else if (term_is_write_congested(paste->wptr.win->term))
+        poller_toggle(paste->event, false); /* Wait until the application reads its input */
+}
+
+static void wayland_resume_paste(struct window *win) {
+    LIST_FOREACH(it, &ctx.paste_fds) {
+        struct active_paste *paste = CONTAINEROF(it, struct active_paste, link);
+        if (paste->wptr.win == win)
+            poller_toggle(paste->event, true);
+    }
 }
 
 static inline int do_start_paste(struct window *win, bool utf8) {
@@ -1678,7 +1693,7 @@ static bool try_handle_csd_button(struct window *win, struct seat *seat, int32_t
         /* Middle mouse button on top border --- close */
         if (top) {
             handled = true;
-            free_window(win);
+            window_close(win);
         }
     } else if (code == 0) {
         /* Left mouse button --- move */
@@ -2283,10 +2298,14 @@ static void wayland_handle_events(void *data_, uint32_t mask) {
 static void handle_callback_done(void *data, struct wl_callback *wl_callback, uint32_t callback_data) {
     struct window *win = data;
     (void)callback_data;
-    if (get_plat(win)->frame_callback)
-        win->inhibit_render_counter--;
     wl_callback_destroy(wl_callback);
     get_plat(win)->frame_callback = NULL;
+    if (get_plat(win)->frame_inhibit) {
+        get_plat(win)->frame_inhibit = false;
+        win->inhibit_render_counter--;
+    }
+    if (win->cfg.vsync)
+        window_frame_presented(win, NULL);
 }
 
 static struct wl_callback_listener frame_callback_listener = {
@@ -2298,18 +2317,30 @@ static void wayland_draw_done(struct window *win) {
 
     struct wl_callback *cb = wl_surface_frame(get_plat(win)->surface);
     wl_callback_add_listener(cb, &frame_callback_listener, win);
-    if (!get_plat(win)->frame_callback)
+    if (get_plat(win)->frame_callback) {
+        wl_callback_destroy(get_plat(win)->frame_callback);
+    } else if (!win->cfg.vsync) {
+        /* Don't draw faster than the compositor displays frames,
+         * with vsync this is handled by window_frame_submitted() */
+        get_plat(win)->frame_inhibit = true;
         win->inhibit_render_counter++;
+    }
     get_plat(win)->frame_callback = cb;
 
     wl_surface_commit(get_plat(win)->surface);
 }
 
+static bool wayland_request_frame(struct window *win) {
+    /* Frame callback is requested on every commit */
+    return get_plat(win)->frame_callback;
+}
+
 static struct platform_vtable wayland_vtable = {
     .get_screen_size = wayland_get_screen_size,
     .has_error = wayland_has_error,
     .get_opaque_size = wayland_get_opaque_size,
     .flush = wayland_flush,
+    .request_frame = wayland_request_frame,
     .get_position = wayland_get_position,
     .init_window = wayland_init_window,
     .free_window = wayland_free_window,
@@ -2321,6 +2352,7 @@ static struct platform_vtable wayland_vtable = {
     .map_window = wayland_map_window,
     .move_window = wayland_move_window,
     .paste = wayland_paste,
+    .resume_paste = wayland_resume_paste,
     .resize_window = wayland_resize_window,
     .set_icon_label = wayland_set_icon_label,
     .set_title = wayland_set_title,
@@ -81,6 +81,9 @@ struct wayland_window {
     bool is_resizing : 1;
     bool is_tiled : 1;
     bool use_ssd : 1;
+    /* Pending frame callback holds a render inhibit,
+     * this is only the case without vsync */
+    bool frame_inhibit : 1;
 } ALIGNED(MALLOC_ALIGNMENT);
 
 extern struct wl_shm *wl_shm;
@@ -28,6 +28,9 @@
 #include <xcb/xcb_cursor.h>
 #include <xcb/xcb.h>
 #include <xcb/xkb.h>
+#if USE_X11PRESENT
+#   include <xcb/present.h>
+#endif
 #include <xkbcommon/xkbcommon-x11.h>
 
 struct cursor {
@@ -57,6 +60,7 @@ struct context {
         xcb_atom_t _NET_WM_STATE_FULLSCREEN;
         xcb_atom_t _NET_WM_STATE_MAXIMIZED_VERT;
         xcb_atom_t _NET_WM_STATE_MAXIMIZED_HORZ;
+        xcb_atom_t _NET_WM_STATE_HIDDEN;
         xcb_atom_t _NET_ACTIVE_WINDOW;
         xcb_atom_t _NET_MOVERESIZE_WINDOW;
         xcb_atom_t WM_DELETE_WINDOW;
@@ -77,6 +81,10 @@ struct context {
     int32_t xkb_core_kbd;
     uint8_t xkb_base_event;
     uint8_t xkb_base_err;
+    /* Non-zero only in double buffered MIT-SHM mode */
+    uint8_t shm_completion_event;
+    /* Non-zero if Present extension is available */
+    uint8_t present_opcode;
 
     void (*renderer_recolor_border)(struct window *);
     void (*renderer_free)(struct window *);
@@ -86,17 +94,21 @@ struct context {
 static struct context ctx;
 xcb_connection_t *con = NULL;
 
-static struct window *window_for_xid(xcb_window_t xid) {
+static struct window *find_window(xcb_window_t xid) {
     LIST_FOREACH(it, &win_list_head) {
         struct window *win = CONTAINEROF(it, struct window, link);
-        if (get_plat(win)->wid == xid) {
-            win->any_event_happened = true;
+        if (get_plat(win)->wid == xid)
             return win;
-        }
     }
     return NULL;
 }
 
+static struct window *window_for_xid(xcb_window_t xid) {
+    struct window *win = find_window(xid);
+    if (win) win->any_event_happened = true;
+    return win;
+}
+
 static xcb_atom_t intern_atom(const char *atom) {
     xcb_atom_t at;
     xcb_generic_error_t *err = NULL;
@@ -194,6 +206,30 @@ cleanup_context:
     return 0;
 }
 
+#if USE_X11PRESENT
+static void configure_present(void) {
+    const xcb_query_extension_reply_t *ext = xcb_get_extension_data(con, &xcb_present_id);
+    if (!ext || !ext->present) {
+        warn("Present extension is not available");
+        return;
+    }
+
+    xcb_present_query_version_cookie_t c = xcb_present_query_version(con,
+            XCB_PRESENT_MAJOR_VERSION, XCB_PRESENT_MINOR_VERSION);
+    xcb_present_query_version_reply_t *rep = xcb_present_query_version_reply(con, c, NULL);
+    if (!rep) {
+        warn("Can't query Present extension version");
+        return;
+    }
+
+    if (gconfig.trace_misc)
+        info("Present extension version %"PRIu32".%"PRIu32, rep->major_version, rep->minor_version);
+    free(rep);
+
+    ctx.present_opcode = ext->major_opcode;
+}
+#endif
+
 static void x11_update_colors(struct window *win) {
     uint32_t values2[2];
     values2[0] = values2[1] = win->bg_premul;
@@ -348,6 +384,22 @@ static int32_t x11_get_workspace(struct window *win) {
     return result;
 }
 
+static void update_wm_hidden(struct window *win) {
+    xcb_get_property_cookie_t c = xcb_get_property(con, 0, get_plat(win)->wid, ctx.atom._NET_WM_STATE, XCB_ATOM_ATOM, 0, 32);
+    xcb_get_property_reply_t *rep = xcb_get_property_reply(con, c, NULL);
+    if (!rep) return;
+
+    xcb_atom_t *states = xcb_get_property_value(rep);
+    size_t count = xcb_get_property_value_length(rep) / sizeof *states;
+    bool hidden = false;
+    for (size_t i = 0; i < count; i++)
+        hidden |= states[i] == ctx.atom._NET_WM_STATE_HIDDEN;
+    free(rep);
+
+    get_plat(win)->wm_hidden = hidden;
+    window_set_obscured(win, get_plat(win)->wm_hidden || get_plat(win)->fully_obscured);
+}
+
 static void x11_get_pointer(struct window *win, struct extent *p, int32_t *pmask) {
     xcb_query_pointer_cookie_t c = xcb_query_pointer(con, get_plat(win)->wid);
     xcb_query_pointer_reply_t *qre = xcb_query_pointer_reply(con, c, NULL);
@@ -758,16 +810,40 @@ static bool x11_init_window(struct window *win) {
     c = xcb_create_gc_checked(con, get_plat(win)->gc, get_plat(win)->wid, mask2, values2);
     if (check_void_cookie(c)) return false;
 
+#if USE_X11PRESENT
+    if (ctx.present_opcode) {
+        xcb_present_select_input(con, xcb_generate_id(con), get_plat(win)->wid,
+                                 XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY);
+    }
+#endif
+
     x11_reload_cursors(win);
     return true;
 }
 
+static bool x11_request_frame(struct window *win) {
+#if USE_X11PRESENT
+    if (ctx.present_opcode) {
+        /* Frames are drawn without PresentPixmap, so this is not
+         * the presentation of the frame, only the next vertical blank */
+        xcb_present_notify_msc(con, get_plat(win)->wid, 0, 0, 1, 0);
+        return true;
+    }
+#else
+    (void)win;
+#endif
+    return false;
+}
+
 static void x11_map_window(struct window *win) {
     xcb_map_window(con, get_plat(win)->wid);
     xcb_flush(con);
 }
 
 static void x11_free_window(struct window *win) {
+    /* Paste cannot continue without the window */
+    memset(&get_plat(win)->paste, 0, sizeof get_plat(win)->paste);
+
     unref_cursor(get_plat(win)->cursor);
     unref_cursor(get_plat(win)->cursor_default);
     unref_cursor(get_plat(win)->cursor_uri);
@@ -842,46 +918,88 @@ static void send_selection_data(struct window *win, xcb_window_t req, xcb_atom_t
     xcb_send_event(con, 0, req, 0, (const char *)&ev);
 }
 
-static void receive_selection_data(struct window *win, xcb_atom_t prop, bool pnotify) {
-    if (prop == XCB_NONE) return;
+static void finish_paste(struct window *win) {
+    if (get_plat(win)->paste.started)
+        term_paste(win->term, NULL, 0, get_plat(win)->paste.utf8, false, true);
+    memset(&get_plat(win)->paste, 0, sizeof get_plat(win)->paste);
+}
 
-    size_t left, offset = 0;
+static void continue_paste(struct window *win) {
+    struct platform_window *plat = get_plat(win);
 
-    do {
-        xcb_get_property_cookie_t pc = xcb_get_property(con, 0, get_plat(win)->wid, prop, XCB_GET_PROPERTY_TYPE_ANY, offset, PASTE_BLOCK_SIZE/4);
+    while (plat->paste.active && !plat->paste.wait_chunk && !term_is_write_congested(win->term)) {
+        xcb_get_property_cookie_t pc = xcb_get_property(con, 0, plat->wid, plat->paste.prop,
+                                                        XCB_GET_PROPERTY_TYPE_ANY, plat->paste.offset, PASTE_READ_SIZE/4);
         xcb_generic_error_t *err = NULL;
         xcb_get_property_reply_t *rep = xcb_get_property_reply(con, pc, &err);
         if (err || !rep) {
             free(err);
             free(rep);
+            finish_paste(win);
             return;
         }
-        left = rep->bytes_after;
-
-        if (pnotify && !rep->value_len && !left) {
-           get_plat(win)->ev_mask &= ~XCB_EVENT_MASK_PROPERTY_CHANGE;
-           xcb_change_window_attributes(con, get_plat(win)->wid, XCB_CW_EVENT_MASK, &get_plat(win)->ev_mask);
-        }
 
         if (rep->type == ctx.atom.INCR) {
-           get_plat(win)->ev_mask |= XCB_EVENT_MASK_PROPERTY_CHANGE;
-           xcb_change_window_attributes(con, get_plat(win)->wid, XCB_CW_EVENT_MASK, &get_plat(win)->ev_mask);
-           xcb_delete_property(con, get_plat(win)->wid, prop);
-           xcb_flush(con);
-           continue;
+            /* Deleting the property requests the first chunk */
+            plat->paste.incr = true;
+            plat->paste.wait_chunk = true;
+            free(rep);
+            xcb_delete_property(con, plat->wid, plat->paste.prop);
+            xcb_flush(con);
+            return;
         }
 
         ssize_t size = rep->format * rep->value_len / 8;
-        if (size || offset || left) {
+        bool end_of_chunk = !rep->bytes_after;
+        /* INCR transfer is terminated by an empty chunk */
+        bool done = end_of_chunk && (!plat->paste.incr || (!size && !plat->paste.offset));
+
+        if (rep->type != XCB_ATOM_NONE)
+            plat->paste.utf8 = rep->type == ctx.atom.UTF8_STRING;
+
+        if (size || plat->paste.started) {
             term_paste(win->term, xcb_get_property_value(rep), size,
-                       rep->type == ctx.atom.UTF8_STRING, !offset, !left);
+                       plat->paste.utf8, !plat->paste.started, done);
+            plat->paste.started = !done;
         }
 
         free(rep);
-        offset += size / 4;
-    } while (left > 0);
+        plat->paste.offset += size / 4;
+
+        if (end_of_chunk) {
+            xcb_delete_property(con, plat->wid, plat->paste.prop);
+            if (done) {
+                memset(&plat->paste, 0, sizeof plat->paste);
+            } else {
+                plat->paste.wait_chunk = true;
+                plat->paste.offset = 0;
+            }
+            xcb_flush(con);
+        }
+    }
+}
+
+static void receive_selection_data(struct window *win, xcb_atom_t prop) {
+    if (prop == XCB_NONE) return;
+
+    /* Newer paste request replaces the unfinished one */
+    finish_paste(win);
 
-    xcb_delete_property(con, get_plat(win)->wid, prop);
+    get_plat(win)->paste.active = true;
+    get_plat(win)->paste.prop = prop;
+    continue_paste(win);
+}
+
+static void receive_selection_chunk(struct window *win, xcb_atom_t prop) {
+    if (!get_plat(win)->paste.active || !get_plat(win)->paste.wait_chunk) return;
+    if (get_plat(win)->paste.prop != prop) return;
+
+    get_plat(win)->paste.wait_chunk = false;
+    continue_paste(win);
+}
+
+static void x11_resume_paste(struct window *win) {
+    continue_paste(win);
 }
 
 static bool x11_has_error(void) {
@@ -1027,7 +1145,9 @@ static bool do_handle_events(bool can_read) {
             }
             if ((ev->atom == XCB_ATOM_PRIMARY || ev->atom == XCB_ATOM_SECONDARY ||
                     ev->atom == ctx.atom.CLIPBOARD) && ev->state == XCB_PROPERTY_NEW_VALUE)
-                receive_selection_data(win, ev->atom, true);
+                receive_selection_chunk(win, ev->atom);
+            else if (ev->atom == ctx.atom._NET_WM_STATE)
+                update_wm_hidden(win);
             break;
         }
         case XCB_SELECTION_NOTIFY: {
@@ -1037,7 +1157,7 @@ static bool do_handle_events(bool can_read) {
                 info("Event: event=SelectionNotify owner=0x%x target=0x%x property=0x%x selection=0x%x",
                         ev->requestor, ev->target, ev->property, ev->selection);
             }
-            receive_selection_data(win, ev->property, false);
+            receive_selection_data(win, ev->property);
             break;
         }
         case XCB_SELECTION_REQUEST: {
@@ -1058,7 +1178,7 @@ static bool do_handle_events(bool can_read) {
                     ev->window, ev->type, ev->data.data32[0], ev->data.data32[1],
                     ev->data.data32[2], ev->data.data32[3], ev->data.data32[4]);
             }
-            if (ev->format == 32 && ev->data.data32[0] == ctx.atom.WM_DELETE_WINDOW) free_window(win);
+            if (ev->format == 32 && ev->data.data32[0] == ctx.atom.WM_DELETE_WINDOW) window_close(win);
             break;
         }
         case XCB_UNMAP_NOTIFY: {
@@ -1067,7 +1187,7 @@ static bool do_handle_events(bool can_read) {
             if (gconfig.trace_events) {
                 info("Event: event=UnmapNotify window=0x%x", ev->window);
             }
-            win->mapped = false;
+            window_set_mapped(win, false);
             break;
         }
         case XCB_MAP_NOTIFY: {
@@ -1076,7 +1196,7 @@ static bool do_handle_events(bool can_read) {
             if (gconfig.trace_events) {
                 info("Event: event=MapNotify window=0x%x", ev->window);
             }
-            win->mapped = true;
+            window_set_mapped(win, true);
             break;
         }
         case XCB_VISIBILITY_NOTIFY: {
@@ -1085,19 +1205,56 @@ static bool do_handle_events(bool can_read) {
             if (gconfig.trace_events) {
                 info("Event: event=VisibilityNotify window=0x%x state=%d", ev->window, ev->state);
             }
-            win->mapped &= ev->state != XCB_VISIBILITY_FULLY_OBSCURED;
+            get_plat(win)->fully_obscured = ev->state == XCB_VISIBILITY_FULLY_OBSCURED;
+            window_set_obscured(win, get_plat(win)->wm_hidden || get_plat(win)->fully_obscured);
             break;
         }
         case XCB_DESTROY_NOTIFY:
         case XCB_REPARENT_NOTIFY:
            /* ignore */
            break;
+#if USE_X11PRESENT
+        case XCB_GE_GENERIC: {
+            xcb_ge_generic_event_t *gev = (xcb_ge_generic_event_t *)event;
+            if (!ctx.present_opcode || gev->extension != ctx.present_opcode ||
+                    gev->event_type != XCB_PRESENT_EVENT_COMPLETE_NOTIFY) {
+                warn("Unknown xcb generic event: extension=%"PRIu8" type=%"PRIu16, gev->extension, gev->event_type);
+                break;
+            }
+            xcb_present_complete_notify_event_t *ev = (xcb_present_complete_notify_event_t *)event;
+            if (!(win = find_window(ev->window))) break;
+            if (gconfig.trace_events) {
+                info("Event: event=PresentCompleteNotify window=0x%x kind=%"PRIu8" msc=%"PRIu64" ust=%"PRIu64,
+                        ev->window, ev->kind, ev->msc, ev->ust);
+            }
+            /* UST is CLOCK_MONOTONIC time in microseconds */
+            struct timespec when = {
+                .tv_sec = ev->ust / 1000000,
+                .tv_nsec = (ev->ust % 1000000) * 1000,
+            };
+            window_frame_presented(win, ev->ust ? &when : NULL);
+            break;
+        }
+#endif
         case 0: {
             xcb_generic_error_t *err = (xcb_generic_error_t*)event;
             warn("[X11 Error] major=%"PRIu8", minor=%"PRIu16", error=%"PRIu8, err->major_code, err->minor_code, err->error_code);
             break;
         }
         default:
+#if USE_X11SHM
+            if (ctx.shm_completion_event && event->response_type == ctx.shm_completion_event) {
+                xcb_shm_completion_event_t *ev = (xcb_shm_completion_event_t *)event;
+                if (gconfig.trace_events) {
+                    info("Event: event=ShmCompletion drawable=0x%x shmseg=0x%x sequence=%"PRIu32,
+                            ev->drawable, ev->shmseg, event->full_sequence);
+                }
+                /* Completion does not require window to be redrawn */
+                if ((win = find_window(ev->drawable)))
+                    x11_shm_handle_completion(win, ev->shmseg, event->full_sequence);
+                break;
+            }
+#endif
             if (event->response_type != ctx.xkb_base_event) {
                 warn("Unknown xcb event type: %02"PRIu8, event->response_type);
                 break;
@@ -1181,6 +1338,7 @@ static struct platform_vtable x11_vtable = {
     .has_error = x11_has_error,
     .get_opaque_size = x11_get_opaque_size,
     .flush = x11_flush,
+    .request_frame = x11_request_frame,
     .get_position = x11_get_position,
     .init_window = x11_init_window,
     .free_window = x11_free_window,
@@ -1192,6 +1350,7 @@ static struct platform_vtable x11_vtable = {
     .map_window = x11_map_window,
     .move_window = x11_move_window,
     .paste = x11_paste,
+    .resume_paste = x11_resume_paste,
     .resize_window = x11_resize_window,
     .set_icon_label = x11_set_icon_label,
     .set_title = x11_set_title,
@@ -1280,6 +1439,10 @@ const struct platform_vtable *platform_init_x11(struct instance_config *cfg) {
         die("Can't configure XKB");
     }
 
+#if USE_X11PRESENT
+    configure_present();
+#endif
+
     int result = xcb_cursor_context_new(con, ctx.screen, &ctx.cursor_ctx);
     if (result) {
         warn("Can't create cursor context: %d", result);
@@ -1299,6 +1462,7 @@ const struct platform_vtable *platform_init_x11(struct instance_config *cfg) {
     ctx.atom._NET_WM_STATE_FULLSCREEN = intern_atom("_NET_WM_STATE_FULLSCREEN");
     ctx.atom._NET_WM_STATE_MAXIMIZED_VERT = intern_atom("_NET_WM_STATE_MAXIMIZED_VERT");
     ctx.atom._NET_WM_STATE_MAXIMIZED_HORZ = intern_atom("_NET_WM_STATE_MAXIMIZED_HORZ");
+    ctx.atom._NET_WM_STATE_HIDDEN = intern_atom("_NET_WM_STATE_HIDDEN");
     ctx.atom._NET_ACTIVE_WINDOW = intern_atom("_NET_ACTIVE_WINDOW");
     ctx.atom._NET_MOVERESIZE_WINDOW = intern_atom("_NET_MOVERESIZE_WINDOW");
     ctx.atom.WM_DELETE_WINDOW = intern_atom("WM_DELETE_WINDOW");
@@ -1342,13 +1506,15 @@ const struct platform_vtable *platform_init_x11(struct instance_config *cfg) {
         x11_vtable.update = x11_shm_update;
         x11_vtable.reload_font = shm_reload_font;
         x11_vtable.resize = shm_resize;
-        x11_vtable.copy = shm_copy;
-        x11_vtable.submit_screen = shm_submit_screen;
+        x11_vtable.copy = x11_shm_copy;
+        x11_vtable.submit_screen = x11_shm_submit_screen;
         x11_vtable.shm_create_image = x11_shm_create_image;
-        ctx.renderer_recolor_border = shm_recolor_border;
+        x11_vtable.draw_end = x11_shm_draw_end;
+        ctx.renderer_recolor_border = x11_shm_recolor_border;
         ctx.renderer_free = x11_shm_free;
         ctx.renderer_free_context = x11_shm_free_context;
         x11_shm_init_context();
+        ctx.shm_completion_event = x11_shm_completion_event();
         break;
 #endif
     default:
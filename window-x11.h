@@ -30,6 +30,22 @@ struct platform_window {
             struct  platform_shm shm;
             xcb_shm_seg_t shm_seg;
             xcb_pixmap_t shm_pixmap;
+
+            /* Second buffer used in double buffered mode,
+             * it is swapped with shm.im after each frame */
+            struct image shm_spare_im;
+            xcb_shm_seg_t shm_spare_seg;
+            /* Sequence numbers of the last ShmPutImage requests
+             * for each segment, 0 if the segment is not used by X server */
+            uint32_t shm_pending;
+            uint32_t shm_spare_pending;
+            /* Regions updated since last swap, these
+             * need to be copied to the spare image */
+            struct rect *shm_damage;
+            size_t shm_damage_count;
+            size_t shm_damage_caps;
+            bool shm_full_damage;
+            bool shm_swap_pending;
         };
 #endif
 #if USE_XRENDER
@@ -60,6 +76,25 @@ struct platform_window {
 
     /* Used to restore maximized window */
     struct rect saved;
+
+    /* Sources of window invisibility */
+    bool fully_obscured;
+    bool wm_hidden;
+
+    /* Selection being received, it is read piece by piece
+     * while the terminal is able to write it to the PTY */
+    struct {
+        xcb_atom_t prop;
+        /* Offset in the property in 32-bit units */
+        uint32_t offset;
+        bool active : 1;
+        bool started : 1;
+        bool utf8 : 1;
+        /* Selection owner uses INCR protocol */
+        bool incr : 1;
+        /* Waiting for the owner to send the next INCR chunk */
+        bool wait_chunk : 1;
+    } paste;
 } ALIGNED(MALLOC_ALIGNMENT);
 
 extern xcb_connection_t *con;
@@ -85,6 +120,12 @@ void x11_shm_free_context(void);
 void x11_shm_free(struct window *win);
 void x11_shm_update(struct window *win, struct rect rect);
 struct image x11_shm_create_image(struct window *win, int16_t width, int16_t height);
+bool x11_shm_submit_screen(struct window *win, int16_t cur_x, ssize_t cur_y, bool cursor, bool marg);
+void x11_shm_copy(struct window *win, struct rect dst, int16_t sx, int16_t sy);
+void x11_shm_recolor_border(struct window *win);
+void x11_shm_draw_end(struct window *win);
+void x11_shm_handle_completion(struct window *win, xcb_shm_seg_t seg, uint32_t sequence);
+uint8_t x11_shm_completion_event(void);
 struct extent x11_shm_size(struct window *win, bool artificial);
 
 void shm_recolor_border(struct window *win);
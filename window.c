@@ -11,19 +11,90 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <poll.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <xkbcommon/xkbcommon.h>
 #include <xkbcommon/xkbcommon-keysyms.h>
 
 #define NUM_BORDERS 4
+#define STATS_BUFFER_SIZE 4096
+/* Maximal duration of glyph cache prewarming between polls */
+#define PREWARM_SLICE (SEC/1000)
+/* Other windows are throttled for this long after a keypress */
+#define INTERACTIVE_TIME (SEC/2)
+/* Delay between creating pooled windows */
+#define POOL_REFILL_DELAY (SEC/10)
+#define MAX_POOL_PROFILES 4
+#define MAX_TITLE_LIST_LEN 256
+
+struct shared_font {
+    ht_head_t head;
+    struct font *font;
+    char *name;
+    double size;
+    double dpi;
+    double gamma;
+    bool force_scalable;
+    bool allow_subst;
+    /* Number of glyph caches using the font */
+    size_t users;
+};
+
+struct shared_cache {
+    ht_head_t head;
+    struct shared_font *font;
+    struct glyph_cache *cache;
+    enum pixel_mode pixmode;
+    int16_t font_spacing;
+    int16_t line_spacing;
+    int16_t underline_width;
+    bool boxdraw;
+    bool force_aligned;
+    /* Number of windows using the cache */
+    size_t users;
+    struct timespec idle_since;
+    /* Position in the list of prewarmed glyphs for all faces */
+    size_t prewarm_pos;
+};
+
+/* Configuration of launches that get windows from the pool */
+struct pool_profile {
+    struct list_head link;
+    struct instance_config cfg;
+};
 
 struct context {
     double font_size;
+    struct event *raster_event;
+    /* Fonts and glyph caches shared between windows */
+    hashtable_t fonts;
+    hashtable_t caches;
+    struct event *font_gc_timer;
+    /* Characters from --prewarm-glyphs */
+    uint32_t *prewarm_chars;
+    size_t prewarm_count;
+    size_t prewarm_caps;
+    /* Statistics not related to a specific window */
+    struct stats stats;
+    /* Window that received keyboard input last */
+    struct window *input_window;
+    struct timespec input_time;
+    uint32_t last_window_id;
+    /* Unmapped windows created ahead of time in daemon mode */
+    struct list_head window_pool;
+    struct list_head pool_profiles;
+    struct event *pool_timer;
+    /* Windows without display resources, which are
+     * waiting to be attached again, see window_detach() */
+    struct list_head detached;
 };
 
 static struct context ctx;
@@ -31,12 +102,18 @@ const struct platform_vtable *pvtbl;
 
 struct list_head win_list_head;
 static volatile sig_atomic_t reload_config;
+static volatile sig_atomic_t dump_stats;
 
 static void handle_sigusr1(int sig) {
     reload_config = 1;
     (void)sig;
 }
 
+static void handle_sigusr2(int sig) {
+    dump_stats = 1;
+    (void)sig;
+}
+
 _Noreturn static void handle_term(int sig) {
     hang_watched_children();
 
@@ -56,11 +133,111 @@ static void handle_hup(int sig) {
     errno = saved_errno;
 }
 
+#define mkfontkey(name__, size__, dpi__, gamma__, scalable__, subst__) ((struct shared_font) { \
+        .head = { .hash = shared_font_hash((name__), (size__), (dpi__), (gamma__), (scalable__), (subst__)) }, \
+        .name = (char *)(name__), .size = (size__), .dpi = (dpi__), .gamma = (gamma__), \
+        .force_scalable = (scalable__), .allow_subst = (subst__) })
+
+static inline uint64_t mix_double(uint64_t hash, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    return uint_hash64(hash ^ bits);
+}
+
+static uint64_t shared_font_hash(const char *name, double size, double dpi, double gamma, bool scalable, bool subst) {
+    uint64_t hash = hash64(name, strlen(name));
+    hash = mix_double(hash, size);
+    hash = mix_double(hash, dpi);
+    hash = mix_double(hash, gamma);
+    return uint_hash64(hash ^ (scalable | subst << 1));
+}
+
+static bool shared_font_cmp(const ht_head_t *a, const ht_head_t *b) {
+    const struct shared_font *fa = (const struct shared_font *)a;
+    const struct shared_font *fb = (const struct shared_font *)b;
+    return fa->size == fb->size && fa->dpi == fb->dpi && fa->gamma == fb->gamma &&
+           fa->force_scalable == fb->force_scalable && fa->allow_subst == fb->allow_subst &&
+           !strcmp(fa->name, fb->name);
+}
+
+static uint64_t shared_cache_hash(struct shared_cache *cache) {
+    uint64_t hash = uint_hash64((uintptr_t)cache->font);
+    hash = uint_hash64(hash ^ cache->pixmode);
+    hash = uint_hash64(hash ^ (uint16_t)cache->font_spacing);
+    hash = uint_hash64(hash ^ (uint16_t)cache->line_spacing);
+    hash = uint_hash64(hash ^ (uint16_t)cache->underline_width);
+    return uint_hash64(hash ^ (cache->boxdraw | cache->force_aligned << 1));
+}
+
+static bool shared_cache_cmp(const ht_head_t *a, const ht_head_t *b) {
+    const struct shared_cache *ca = (const struct shared_cache *)a;
+    const struct shared_cache *cb = (const struct shared_cache *)b;
+    return ca->font == cb->font && ca->pixmode == cb->pixmode &&
+           ca->font_spacing == cb->font_spacing && ca->line_spacing == cb->line_spacing &&
+           ca->underline_width == cb->underline_width && ca->boxdraw == cb->boxdraw &&
+           ca->force_aligned == cb->force_aligned;
+}
+
+static void free_shared_cache(struct shared_cache *cache) {
+    struct shared_font *font = cache->font;
+
+    free_glyph_cache(cache->cache);
+    free(cache);
+
+    if (--font->users == 0) {
+        ht_erase(&ctx.fonts, &font->head);
+        free_font(font->font);
+        free(font->name);
+        free(font);
+    }
+}
+
 static void tick(void *arg);
+static void free_window_pool(void);
+static void dump_window_geometry(struct window *win);
+
+static void handle_rasterized(void *arg, uint32_t mask) {
+    (void)arg, (void)mask;
+
+    if (!glyph_raster_collect()) return;
+
+    /* Only windows using caches that received glyphs are scanned,
+     * and only cells that were waiting for glyphs are repainted */
+    LIST_FOREACH(it, &win_list_head) {
+        struct window *win = CONTAINEROF(it, struct window, link);
+        if (win->shared_cache && glyph_cache_is_rasterized(win->shared_cache->cache))
+            win->any_event_happened = true;
+    }
+}
+
+static void init_prewarm_chars(const char *str) {
+    while (str && *str) {
+        char *end;
+        unsigned long from = strtoul(str, &end, 16), to = from;
+        if (end != str && *end == '-')
+            to = strtoul(end + 1, &end, 16);
+        if (end == str || (*end && *end != ',') || to < from || to > 0x10FFFF) {
+            warn("Invalid code point range: '%s'", str);
+            return;
+        }
+
+        adjust_buffer((void **)&ctx.prewarm_chars, &ctx.prewarm_caps,
+                      ctx.prewarm_count + (to - from + 1), sizeof *ctx.prewarm_chars);
+        for (unsigned long ch = from; ch <= to; ch++)
+            ctx.prewarm_chars[ctx.prewarm_count++] = ch;
+
+        str = *end ? end + 1 : end;
+    }
+}
 
 void init_context(struct instance_config *cfg) {
     poller_add_tick(tick, NULL);
     list_init(&win_list_head);
+    list_init(&ctx.window_pool);
+    list_init(&ctx.pool_profiles);
+    list_init(&ctx.detached);
+    ht_init(&ctx.fonts, HT_INIT_CAPS, shared_font_cmp);
+    ht_init(&ctx.caches, HT_INIT_CAPS, shared_cache_cmp);
 
     if (!pvtbl && USE_WAYLAND)
         pvtbl = platform_init_wayland(cfg);
@@ -69,8 +246,15 @@ void init_context(struct instance_config *cfg) {
     if (!pvtbl)
         die("Cannot find suitable backend");
 
+    if (gconfig.async_rasterization) {
+        int fd = glyph_raster_init();
+        if (fd >= 0) ctx.raster_event = poller_add_fd(handle_rasterized, NULL, fd, POLLIN);
+    }
+
+    init_prewarm_chars(gconfig.prewarm_glyphs);
+
     sigaction(SIGUSR1, &(struct sigaction){ .sa_handler = handle_sigusr1, .sa_flags = SA_RESTART }, NULL);
-    sigaction(SIGUSR2, &(struct sigaction){ .sa_handler = handle_sigusr1, .sa_flags = SA_RESTART }, NULL);
+    sigaction(SIGUSR2, &(struct sigaction){ .sa_handler = handle_sigusr2, .sa_flags = SA_RESTART }, NULL);
     sigaction(SIGHUP, &(struct sigaction) { .sa_handler = handle_hup, .sa_flags = SA_RESTART}, NULL);
 
     struct sigaction sa = { .sa_handler = handle_term };
@@ -81,12 +265,28 @@ void init_context(struct instance_config *cfg) {
 }
 
 void free_context(void) {
+    free_window_pool();
+    LIST_FOREACH_SAFE(it, &ctx.detached)
+        free_window(CONTAINEROF(it, struct window, link));
     LIST_FOREACH_SAFE(it, &win_list_head)
         free_window(CONTAINEROF(it, struct window, link));
 
     if (gconfig.daemon_mode)
         unlink(gconfig.sockpath);
 
+    poller_unset(&ctx.font_gc_timer);
+    ht_iter_t it = ht_begin(&ctx.caches);
+    while (ht_current(&it))
+        free_shared_cache((struct shared_cache *)ht_erase_current(&it));
+    ht_free(&ctx.caches);
+    ht_free(&ctx.fonts);
+    free(ctx.prewarm_chars);
+
+    if (ctx.raster_event) {
+        poller_remove(ctx.raster_event);
+        glyph_raster_free();
+    }
+
     pvtbl->free();
 
 #if USE_URI
@@ -118,7 +318,7 @@ void window_set_colors(struct window *win, color_t bg, color_t cursor_fg) {
     bool bg_changed = bg && win->bg_premul != obg;
 
     if (bg_changed) {
-        pvtbl->update_colors(win);
+        win->vtbl->update_colors(win);
     }
 
     if (cfg_changed || bg_changed) {
@@ -134,10 +334,11 @@ void window_set_mouse(struct window *win, bool enabled) {
 #if USE_URI
     window_set_active_uri(win, EMPTY_URI, 0);
 #endif
-    pvtbl->enable_mouse_events(win, enabled);
+    win->vtbl->enable_mouse_events(win, enabled);
 }
 
 static void window_delay_redraw_after_read(struct window *win);
+static void charge_window_time(struct window *win, struct timespec *start);
 
 // FIXME Move this to tty.c
 void handle_term_read(void *win_, uint32_t mask) {
@@ -146,13 +347,23 @@ void handle_term_read(void *win_, uint32_t mask) {
     if (UNLIKELY(mask & (POLLHUP | POLLERR | POLLNVAL))) {
         if (term_hang(win->term)) return;
     } else {
-        if (!term_read(win->term)) return;
+        /* Keep reading while the window has budget left
+         * for this iteration, not just a single buffer */
+        bool has_read = false, more;
+        do {
+            struct timespec start;
+            clock_gettime(CLOCK_TYPE, &start);
+            more = term_read(win->term);
+            charge_window_time(win, &start);
+            has_read |= more;
+        } while (more && gconfig.read_quantum && win->read_credit > 0 && !win->inhibit_read_counter);
+        if (!has_read) return;
     }
 
     window_delay_redraw_after_read(win);
     win->any_event_happened = true;
-    if (pvtbl->after_read)
-        pvtbl->after_read(win);
+    if (win->vtbl->after_read)
+        win->vtbl->after_read(win);
 }
 
 static inline void dec_read_inhibit(struct window *win) {
@@ -175,6 +386,40 @@ static inline void inc_render_inhibit(struct window *win) {
     win->inhibit_render_counter++;
 }
 
+static inline bool window_is_interactive(struct window *win) {
+    return win->focused || win == ctx.input_window;
+}
+
+/* Windows are scheduled with deficit round robin: each one gets
+ * --read-quantum of parsing and rendering time per loop iteration.
+ * A window that has used up its budget stops reading until it is
+ * refilled by tick(), but only while the user is typing in some
+ * other window. */
+static void charge_window_time(struct window *win, struct timespec *start) {
+    if (!gconfig.read_quantum) return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_TYPE, &now);
+    win->read_credit -= ts_diff(start, &now);
+
+    if (win->read_credit > 0 || win->read_throttled || window_is_interactive(win) ||
+        !ctx.input_window || ts_diff(&ctx.input_time, &now) >= INTERACTIVE_TIME) return;
+
+    win->read_throttled = true;
+    inc_read_inhibit(win);
+    stats_add(&win->stats, stat_reads_throttled, 1);
+}
+
+static void refill_read_credit(struct window *win) {
+    int64_t quantum = gconfig.read_quantum;
+    win->read_credit = quantum ? MIN(quantum, win->read_credit + quantum) : 0;
+
+    if (win->read_throttled && (win->read_credit > 0 || !quantum)) {
+        win->read_throttled = false;
+        dec_read_inhibit(win);
+    }
+}
+
 void window_reset_delayed_redraw(struct window *win) {
     win->any_event_happened = true;
     if (poller_unset(&win->redraw_delay_timer))
@@ -209,18 +454,18 @@ static inline void wait_for_configure(struct window *win, int mult) {
 }
 
 bool window_action(struct window *win, enum window_action act) {
-    bool success = pvtbl->window_action(win, act);
+    bool success = win->vtbl->window_action(win, act);
     if (success)
         wait_for_configure(win, 1);
     return success;
 }
 
 void window_move(struct window *win, int16_t x, int16_t y) {
-    pvtbl->move_window(win, x, y);
+    win->vtbl->move_window(win, x, y);
 }
 
 bool window_resize(struct window *win, int16_t width, int16_t height) {
-    bool success = pvtbl->resize_window(win, width, height);
+    bool success = win->vtbl->resize_window(win, width, height);
     if (success)
         wait_for_configure(win, 1);
     return success;
@@ -230,7 +475,7 @@ bool window_resize(struct window *win, int16_t width, int16_t height) {
 void window_get_pointer(struct window *win, int16_t *px, int16_t *py, uint32_t *pmask) {
     struct extent ext = {0, 0};
     int32_t mask = 0;
-    pvtbl->get_pointer(win, &ext, &mask);
+    win->vtbl->get_pointer(win, &ext, &mask);
     if (px) *px = ext.width;
     if (py) *py = ext.height;
     if (pmask) *pmask = mask;
@@ -242,7 +487,7 @@ void window_set_clip(struct window *win, uint8_t *data, enum clip_target target)
         free(data);
         return;
     }
-    if (data && !pvtbl->set_clip(win, target)) {
+    if (data && !win->vtbl->set_clip(win, target)) {
         free(data);
         data = NULL;
     }
@@ -299,8 +544,8 @@ bool window_get_sync(struct window *win) {
 }
 
 void window_set_autorepeat(struct window *win, bool state) {
-    if (pvtbl->set_autorepeat)
-        pvtbl->set_autorepeat(win, state);
+    if (win->vtbl->set_autorepeat)
+        win->vtbl->set_autorepeat(win, state);
     win->autorepeat = state;
 }
 
@@ -349,7 +594,7 @@ void window_bell(struct window *win, uint8_t vol) {
         if (term_is_bell_raise_enabled(win->term))
             window_action(win, action_raise);
         if (term_is_bell_urgent_enabled(win->term))
-            pvtbl->set_urgency(win, 1);
+            win->vtbl->set_urgency(win, 1);
     }
     if (win->cfg.visual_bell) {
         if (!win->visual_bell_timer) {
@@ -359,7 +604,7 @@ void window_bell(struct window *win, uint8_t vol) {
             term_set_reverse(win->term, !win->init_invert);
         }
     } else if (vol) {
-        pvtbl->bell(win, vol);
+        win->vtbl->bell(win, vol);
     }
 }
 
@@ -370,7 +615,7 @@ void window_update_pointer_mode(struct window *win) {
                      term_get_mstate(win->term)->mouse_mode == mouse_mode_none));
     if (hide != win->pointer_is_hidden) {
         win->pointer_is_hidden = hide;
-        if (!pvtbl->try_update_pointer_mode(win, hide))
+        if (!win->vtbl->try_update_pointer_mode(win, hide))
             win->pointer_is_hidden = !hide;
     }
 }
@@ -381,15 +626,15 @@ void window_set_pointer_mode(struct window *win, enum hide_pointer_mode mode) {
 }
 
 void window_set_pointer_shape(struct window *win, const char *shape) {
-    pvtbl->select_cursor(win, shape);
+    win->vtbl->select_cursor(win, shape);
 }
 
 struct extent window_get_position(struct window *win) {
-    return pvtbl->get_position(win);
+    return win->vtbl->get_position(win);
 }
 
 struct extent window_get_grid_position(struct window *win) {
-    struct extent res = pvtbl->get_position(win);
+    struct extent res = win->vtbl->get_position(win);
     res.width += win->cfg.border.left;
     res.height += win->cfg.border.top;
     return res;
@@ -400,7 +645,7 @@ struct extent window_get_grid_size(struct window *win) {
 }
 
 struct extent window_get_screen_size(struct window *win) {
-    return pvtbl->get_screen_size(win);
+    return win->vtbl->get_screen_size(win);
 }
 
 struct extent window_get_cell_size(struct window *win) {
@@ -416,7 +661,7 @@ struct extent window_get_size(struct window *win) {
 }
 
 void window_get_title(struct window *win, enum title_target which, char **name, bool *utf8) {
-    pvtbl->get_title(win, which, name, utf8);
+    win->vtbl->get_title(win, which, name, utf8);
 }
 
 void window_push_title(struct window *win, enum title_target which) {
@@ -451,11 +696,11 @@ void window_pop_title(struct window *win, enum title_target which) {
     if (top) {
         if (which & target_title) {
             for (it = top; it && !it->title_data; it = it->next);
-            if (it) pvtbl->set_title(win, it->title_data, it->title_utf8);
+            if (it) win->vtbl->set_title(win, it->title_data, it->title_utf8);
         }
         if (which & target_icon_label) {
             for (it = top; it && !it->icon_data; it = it->next);
-            if (it) pvtbl->set_icon_label(win, it->icon_data, it->icon_utf8);
+            if (it) win->vtbl->set_icon_label(win, it->icon_data, it->icon_utf8);
         }
         win->title_stack = top->next;
         free(top);
@@ -466,7 +711,7 @@ static bool handle_blink(void *win_) {
     struct window *win = win_;
     win->rcstate.blink ^= true;
     win->blink_committed = false;
-    win->any_event_happened = true;
+    win->blink_damaged = true;
     return true;
 }
 
@@ -482,8 +727,8 @@ static void reload_window(struct window *win) {
         free(cpath);
     }
 
-    if (pvtbl->reload_config)
-        pvtbl->reload_config(win);
+    if (win->vtbl->reload_config)
+        win->vtbl->reload_config(win);
 
     window_set_alpha(win, win->cfg.alpha);
     term_reload_config(win->term);
@@ -503,11 +748,14 @@ static void reload_window(struct window *win) {
     poller_unset(&win->blink_timer);
     poller_unset(&win->blink_inhibit_timer);
     poller_unset(&win->pointer_inhibit_timer);
-    if (win->cfg.allow_blinking)
-         poller_set_timer(&win->blink_timer, handle_blink, win, win->cfg.blink_time);
+    /* Detached windows are not displayed, so they don't blink */
+    if (win->cfg.allow_blinking && win->vtbl == pvtbl) {
+        poller_set_timer(&win->blink_timer, handle_blink, win, win->cfg.blink_time);
+        poller_set_slack(win->blink_timer, win->cfg.blink_time);
+    }
 
-    pvtbl->reload_cursors(win);
-    pvtbl->reload_font(win, true);
+    win->vtbl->reload_cursors(win);
+    win->vtbl->reload_font(win, true);
     queue_force_redraw(win);
 }
 
@@ -515,6 +763,10 @@ static void do_reload_config(void) {
     init_instance_config(&global_instance_config, global_instance_config.config_path, 1);
     LIST_FOREACH_SAFE(it, &win_list_head)
         reload_window(CONTAINEROF(it, struct window, link));
+    LIST_FOREACH_SAFE(it, &ctx.detached)
+        reload_window(CONTAINEROF(it, struct window, link));
+    /* Pooled windows were created with outdated configuration */
+    free_window_pool();
     reload_config = false;
 }
 
@@ -528,7 +780,7 @@ static void window_set_font(struct window *win, const char * name, int32_t size)
     if (size >= 0) win->cfg.font_size = size;
 
     if (reload) {
-        pvtbl->reload_font(win, true);
+        win->vtbl->reload_font(win, true);
         screen_damage_lines(term_screen(win->term), 0, win->c.height);
         queue_force_redraw(win);
     }
@@ -537,62 +789,154 @@ static void window_set_font(struct window *win, const char * name, int32_t size)
 void window_set_title(struct window *win, enum title_target which, const char *title, bool utf8) {
     if (!title) title = win->cfg.title;
 
-    if (which & target_title) pvtbl->set_title(win, title, utf8);
+    if (which & target_title) win->vtbl->set_title(win, title, utf8);
 
-    if (which & target_icon_label) pvtbl->set_icon_label(win, title, utf8);
+    if (which & target_icon_label) win->vtbl->set_icon_label(win, title, utf8);
 }
 
-struct window *window_find_shared_font(struct window *win, bool need_free, bool force_aligned) {
-    bool found_font = 0, found_cache = 0;
-    struct window *found = NULL;
+/* Frees glyph caches that were not used by any window
+ * for longer than --font-keep-time */
+static bool handle_font_gc(void *arg) {
+    (void)arg;
 
-    LIST_FOREACH_SAFE(it, &win_list_head) {
-        struct window *src = CONTAINEROF(it, struct window, link);
-        if ((src->cfg.font_size == win->cfg.font_size || (!win->cfg.font_size && src->cfg.font_size == ctx.font_size)) &&
-                src->cfg.dpi == win->cfg.dpi && src->cfg.force_scalable == win->cfg.force_scalable &&
-                src->cfg.allow_subst_font == win->cfg.allow_subst_font && src->cfg.gamma == win->cfg.gamma &&
-                !strcmp(win->cfg.font_name, src->cfg.font_name) && src != win) {
-            found_font = 1;
-            found = src;
-            if (win->font_pixmode == src->font_pixmode && win->cfg.font_spacing == src->cfg.font_spacing &&
-                    win->cfg.line_spacing == src->cfg.line_spacing && win->cfg.override_boxdraw == src->cfg.override_boxdraw) {
-                found_cache = 1;
-                break;
-            }
+    struct timespec now;
+    clock_gettime(CLOCK_TYPE, &now);
+
+    bool has_idle = false;
+    ht_iter_t it = ht_begin(&ctx.caches);
+    while (ht_current(&it)) {
+        struct shared_cache *cache = (struct shared_cache *)ht_current(&it);
+        if (cache->users || ts_diff(&cache->idle_since, &now) < gconfig.font_keep_time) {
+            has_idle |= !cache->users;
+            ht_next(&it);
+            continue;
         }
+
+        if (gconfig.trace_fonts)
+            info("Freeing unused font cache '%s' size=%g", cache->font->name, cache->font->size);
+        ht_erase_current(&it);
+        free_shared_cache(cache);
     }
 
-    struct font *newf = found_font ? font_ref(found->font) :
-            create_font(win->cfg.font_name, win->cfg.font_size, win->cfg.dpi, win->cfg.gamma, win->cfg.force_scalable, win->cfg.allow_subst_font);
-    if (!newf) {
+    return has_idle;
+}
+
+static void release_shared_cache(struct window *win) {
+    struct shared_cache *cache = win->shared_cache;
+    if (!cache) return;
+
+    win->shared_cache = NULL;
+    win->font_cache = NULL;
+    win->font = NULL;
+
+    if (--cache->users) return;
+
+    if (!gconfig.font_keep_time) {
+        ht_erase(&ctx.caches, &cache->head);
+        free_shared_cache(cache);
+        return;
+    }
+
+    /* Keep the cache warm for windows created later */
+    clock_gettime(CLOCK_TYPE, &cache->idle_since);
+    if (!ctx.font_gc_timer) {
+        ctx.font_gc_timer = poller_add_timer(handle_font_gc, NULL, gconfig.font_keep_time);
+        poller_set_autoreset(ctx.font_gc_timer, &ctx.font_gc_timer);
+        poller_set_slack(ctx.font_gc_timer, SEC);
+    }
+}
+
+static struct shared_font *acquire_shared_font(struct window *win) {
+    /* Zero size means default size, which is determined by the first font */
+    double size = win->cfg.font_size ? win->cfg.font_size : ctx.font_size;
+    struct shared_font dummy = mkfontkey(win->cfg.font_name, size, win->cfg.dpi, win->cfg.gamma,
+                                         win->cfg.force_scalable, win->cfg.allow_subst_font);
+
+    ht_head_t **h = ht_lookup_ptr(&ctx.fonts, &dummy.head);
+    if (*h) return (struct shared_font *)*h;
+
+    struct font *font = create_font(win->cfg.font_name, size, win->cfg.dpi,
+                                    win->cfg.gamma, win->cfg.force_scalable, win->cfg.allow_subst_font);
+    if (!font) return NULL;
+
+    /* Insert under the lookup key, unless it is the very first font */
+    if (!size) size = font_get_size(font);
+
+    struct shared_font *new = xalloc(sizeof *new);
+    *new = mkfontkey(strdup(win->cfg.font_name), size, win->cfg.dpi, win->cfg.gamma,
+                     win->cfg.force_scalable, win->cfg.allow_subst_font);
+    new->font = font;
+    new->users = 0;
+    ht_insert(&ctx.fonts, &new->head);
+    return new;
+}
+
+struct window *window_find_shared_font(struct window *win, bool need_free, bool force_aligned) {
+    struct shared_font *font = acquire_shared_font(win);
+    if (!font) {
         warn("Can't create new font: %s", win->cfg.font_name);
         return NULL;
     }
 
-    struct glyph_cache *newc = found_cache ? glyph_cache_ref(found->font_cache) :
-            create_glyph_cache(newf, win->cfg.pixel_mode, win->cfg.line_spacing, win->cfg.font_spacing,
-                               win->cfg.underline_width, win->cfg.override_boxdraw, force_aligned);
-
-    if (need_free) {
-        free_glyph_cache(win->font_cache);
-        free_font(win->font);
+    struct shared_cache dummy = {
+        .font = font,
+        .pixmode = win->cfg.pixel_mode,
+        .font_spacing = win->cfg.font_spacing,
+        .line_spacing = win->cfg.line_spacing,
+        .underline_width = win->cfg.underline_width,
+        .boxdraw = win->cfg.override_boxdraw,
+        .force_aligned = force_aligned,
+    };
+    dummy.head.hash = shared_cache_hash(&dummy);
+
+    ht_head_t **h = ht_lookup_ptr(&ctx.caches, &dummy.head);
+    struct shared_cache *cache = (struct shared_cache *)*h;
+    if (!cache) {
+        cache = xalloc(sizeof *cache);
+        *cache = dummy;
+        cache->cache = create_glyph_cache(font->font, dummy.pixmode, dummy.line_spacing, dummy.font_spacing,
+                                          dummy.underline_width, dummy.boxdraw, force_aligned);
+        font->users++;
+        ht_insert_hint(&ctx.caches, h, &cache->head);
+    } else if (gconfig.trace_fonts) {
+        info("Reusing font cache '%s' size=%g users=%zu", font->name, font->size, cache->users);
     }
 
-    win->font = newf;
-    win->font_cache = newc;
+    cache->users++;
+
+    if (need_free) release_shared_cache(win);
+
+    win->shared_cache = cache;
+    win->font = font->font;
+    win->font_cache = cache->cache;
     win->undercurl_glyph = glyph_cache_fetch(win->font_cache, GLYPH_UNDERCURL, face_normal, NULL);
-    win->cfg.font_size = font_get_size(newf);
+    win->cfg.font_size = font_get_size(win->font);
 
     /* Initialize default font size */
     if (!ctx.font_size) ctx.font_size = win->cfg.font_size;
 
     glyph_cache_get_dim(win->font_cache, &win->char_width, &win->char_height, &win->char_depth);
 
-    return found;
+    /* Backends can share resources with other
+     * windows using the same glyph cache */
+    LIST_FOREACH(it, &win_list_head) {
+        struct window *src = CONTAINEROF(it, struct window, link);
+        if (src != win && src->shared_cache == cache) return src;
+    }
+
+    return NULL;
 }
 
-struct window *create_window(struct instance_config *cfg) {
-    struct window *win = xzalloc(sizeof(struct window) + pvtbl->get_opaque_size());
+/* Windows can be moved to the headless backend, so they
+ * have enough space for the state of either backend */
+static ssize_t window_opaque_size(void) {
+    return MAX(pvtbl->get_opaque_size(), platform_init_headless()->get_opaque_size());
+}
+
+/* Creates a window without mapping it or adding it to any list */
+static struct window *new_window(struct instance_config *cfg) {
+    struct window *win = xzalloc(sizeof(struct window) + window_opaque_size());
+    win->vtbl = pvtbl;
 
     copy_config(&win->cfg, cfg);
 
@@ -602,15 +946,16 @@ struct window *create_window(struct instance_config *cfg) {
     win->autorepeat = win->cfg.autorepeat;
     win->mapped = true;
     win->focused = true;
+    win->id = ++ctx.last_window_id;
 
     if (!win->cfg.font_name) {
         free_window(win);
         return NULL;
     }
 
-    if (!pvtbl->init_window(win)) goto error;
+    if (!win->vtbl->init_window(win)) goto error;
 
-    if (!pvtbl->reload_font(win, false)) goto error;
+    if (!win->vtbl->reload_font(win, false)) goto error;
 
     win->term = create_term(win, MAX(win->c.width, 2), MAX(win->c.height, 1));
     if (!win->term) goto error;
@@ -622,14 +967,12 @@ struct window *create_window(struct instance_config *cfg) {
     if (win->cfg.allow_blinking) {
         win->blink_timer = poller_add_timer(handle_blink, win, win->cfg.blink_time);
         poller_set_autoreset(win->blink_timer, &win->blink_timer);
+        /* Blink all windows in phase, so they are handled in a single wakeup */
+        poller_set_slack(win->blink_timer, win->cfg.blink_time);
     }
 
     window_set_title(win, target_title | target_icon_label, NULL,
                      win->cfg.utf8 || win->cfg.force_utf8_title);
-
-    list_insert_after(&win_list_head, &win->link);
-
-    pvtbl->map_window(win);
     return win;
 
 error:
@@ -638,12 +981,295 @@ error:
     return NULL;
 }
 
+struct window *create_window(struct instance_config *cfg) {
+    struct window *win = new_window(cfg);
+    if (!win) return NULL;
+
+    list_insert_after(&win_list_head, &win->link);
+
+    win->vtbl->map_window(win);
+    return win;
+}
+
+static bool strings_equal(const char *a, const char *b) {
+    return a == b || (a && b && !strcmp(a, b));
+}
+
+/* Launches with the same configuration file and working directory
+ * share pooled windows, everything else is taken from the file */
+static bool pool_profile_matches(struct instance_config *a, struct instance_config *b) {
+    return strings_equal(a->config_path, b->config_path) && strings_equal(a->cwd, b->cwd);
+}
+
+static struct pool_profile *find_pool_profile(struct instance_config *cfg) {
+    LIST_FOREACH(it, &ctx.pool_profiles) {
+        struct pool_profile *prof = CONTAINEROF(it, struct pool_profile, link);
+        if (pool_profile_matches(&prof->cfg, cfg)) return prof;
+    }
+    return NULL;
+}
+
+static void free_pool_profile(struct pool_profile *prof) {
+    LIST_FOREACH_SAFE(it, &ctx.window_pool) {
+        struct window *win = CONTAINEROF(it, struct window, link);
+        if (pool_profile_matches(&win->cfg, &prof->cfg))
+            free_window(win);
+    }
+
+    list_remove(&prof->link);
+    free_config(&prof->cfg);
+    free(prof);
+}
+
+static bool pool_is_full(struct pool_profile *prof) {
+    int64_t count = 0;
+    LIST_FOREACH(it, &ctx.window_pool) {
+        struct window *win = CONTAINEROF(it, struct window, link);
+        count += pool_profile_matches(&win->cfg, &prof->cfg);
+    }
+    return count >= gconfig.window_pool_size;
+}
+
+/* Creates one pooled window per call, so that the poller
+ * can handle input and other windows between them */
+static bool handle_pool_refill(void *arg) {
+    (void)arg;
+
+    struct timespec now;
+    clock_gettime(CLOCK_TYPE, &now);
+
+    /* Starting a shell is expensive, don't do it while the user is typing */
+    if (ctx.input_window && ts_diff(&ctx.input_time, &now) < INTERACTIVE_TIME)
+        return true;
+
+    LIST_FOREACH(it, &ctx.pool_profiles) {
+        struct pool_profile *prof = CONTAINEROF(it, struct pool_profile, link);
+        if (pool_is_full(prof)) continue;
+
+        struct window *win = new_window(&prof->cfg);
+        if (!win) {
+            /* Don't retry the profile that cannot be created */
+            free_pool_profile(prof);
+            return !list_empty(&ctx.pool_profiles);
+        }
+
+        list_insert_after(&ctx.window_pool, &win->link);
+        return true;
+    }
+
+    return false;
+}
+
+static void remember_pool_profile(struct instance_config *cfg) {
+    struct pool_profile *prof = find_pool_profile(cfg);
+    if (prof) {
+        /* Keep recently used profiles at the front */
+        list_remove(&prof->link);
+    } else {
+        size_t count = 0;
+        LIST_FOREACH(it, &ctx.pool_profiles)
+            count++;
+        if (count >= MAX_POOL_PROFILES)
+            free_pool_profile(CONTAINEROF(ctx.pool_profiles.prev, struct pool_profile, link));
+
+        prof = xzalloc(sizeof *prof);
+        copy_config(&prof->cfg, cfg);
+    }
+
+    list_insert_after(&ctx.pool_profiles, &prof->link);
+
+    if (!ctx.pool_timer) {
+        ctx.pool_timer = poller_add_timer(handle_pool_refill, NULL, POOL_REFILL_DELAY);
+        poller_set_autoreset(ctx.pool_timer, &ctx.pool_timer);
+    }
+}
+
+/* Maps a pre-created window matching the launch configuration,
+ * if there is any. Title is the only option that is applied
+ * to the window after it was created, so the caller should not
+ * use the pool for launches that set anything else. */
+struct window *window_pool_take(struct instance_config *cfg) {
+    if (!gconfig.window_pool_size) return NULL;
+
+    remember_pool_profile(cfg);
+
+    LIST_FOREACH(it, &ctx.window_pool) {
+        struct window *win = CONTAINEROF(it, struct window, link);
+        if (!pool_profile_matches(&win->cfg, cfg) || term_exited(win->term)) continue;
+
+        list_remove(&win->link);
+        list_insert_after(&win_list_head, &win->link);
+
+        if (!strings_equal(win->cfg.title, cfg->title)) {
+            free(win->cfg.title);
+            win->cfg.title = cfg->title ? strdup(cfg->title) : NULL;
+            window_set_title(win, target_title | target_icon_label, NULL,
+                             win->cfg.utf8 || win->cfg.force_utf8_title);
+        }
+
+        win->vtbl->map_window(win);
+        return win;
+    }
+
+    return NULL;
+}
+
+/* Replaces the platform backend of the window, keeping its title.
+ * Old backend state should be freed by the caller. */
+static bool switch_window_backend(struct window *win, const struct platform_vtable *vtbl,
+                                  char *title, bool tutf8, char *icon, bool iutf8) {
+    memset(win->platform_window_opaque, 0, window_opaque_size());
+    win->vtbl = vtbl;
+    win->mapped = true;
+    win->focused = false;
+
+    if (!vtbl->init_window(win) || !vtbl->reload_font(win, false)) return false;
+
+    if (title) vtbl->set_title(win, title, tutf8);
+    else window_set_title(win, target_title, NULL, win->cfg.utf8 || win->cfg.force_utf8_title);
+    if (icon) vtbl->set_icon_label(win, icon, iutf8);
+    else window_set_title(win, target_icon_label, NULL, win->cfg.utf8 || win->cfg.force_utf8_title);
+    return true;
+}
+
+/* Frees display and renderer resources of the window.
+ * Terminal keeps running and parsing the output
+ * until the window is attached again. */
+bool window_detach(struct window *win) {
+    const struct platform_vtable *headless = platform_init_headless();
+    if (win->vtbl == headless) return false;
+
+    char *title = NULL, *icon = NULL;
+    bool tutf8 = false, iutf8 = false;
+    win->vtbl->get_title(win, target_title, &title, &tutf8);
+    win->vtbl->get_title(win, target_icon_label, &icon, &iutf8);
+
+    /* These timers only make sense for displayed windows */
+    if (poller_unset(&win->frame_timer))
+        dec_render_inhibit(win);
+    if (poller_unset(&win->sync_update_timeout_timer))
+        dec_render_inhibit(win);
+    if (poller_unset(&win->smooth_scroll_timer))
+        dec_read_inhibit(win);
+    if (poller_unset(&win->configure_delay_timer))
+        dec_read_inhibit(win);
+    poller_unset(&win->blink_timer);
+    poller_unset(&win->blink_inhibit_timer);
+    poller_unset(&win->pointer_inhibit_timer);
+    poller_unset(&win->visual_bell_timer);
+    win->frame_stalled = false;
+    win->frame_feedback_pending = false;
+    win->obscured = false;
+    win->latency_pending = false;
+
+    /* Detached window does not have any geometry */
+    if (win->cfg.save_geometry_path)
+        dump_window_geometry(win);
+
+    win->vtbl->free_window(win);
+    release_shared_cache(win);
+
+    if (ctx.input_window == win)
+        ctx.input_window = NULL;
+
+    /* Headless backend cannot fail */
+    switch_window_backend(win, headless, title, tutf8, icon, iutf8);
+    free(title);
+    free(icon);
+
+    list_remove(&win->link);
+    list_insert_after(&ctx.detached, &win->link);
+    if (gconfig.daemon_mode)
+        daemon_report_load();
+    return true;
+}
+
+/* Recreates the display window for a detached terminal, keeping
+ * its grid size. Contents are repainted from the screen. */
+struct window *window_attach(uint32_t id) {
+    struct window *win = NULL;
+    LIST_FOREACH(it, &ctx.detached) {
+        struct window *cand = CONTAINEROF(it, struct window, link);
+        if (cand->id == id) {
+            win = cand;
+            break;
+        }
+    }
+    if (!win) return NULL;
+
+    char *title = NULL, *icon = NULL;
+    bool tutf8 = false, iutf8 = false;
+    win->vtbl->get_title(win, target_title, &title, &tutf8);
+    win->vtbl->get_title(win, target_icon_label, &icon, &iutf8);
+    win->vtbl->free_window(win);
+
+    win->cfg.geometry.char_geometry = true;
+    win->cfg.geometry.has_extent = true;
+    win->cfg.geometry.r.width = win->c.width;
+    win->cfg.geometry.r.height = win->c.height;
+
+    bool success = switch_window_backend(win, pvtbl, title, tutf8, icon, iutf8);
+    if (!success) {
+        warn("Can't attach window");
+        win->vtbl->free_window(win);
+        release_shared_cache(win);
+        switch_window_backend(win, platform_init_headless(), title, tutf8, icon, iutf8);
+    }
+
+    free(title);
+    free(icon);
+    if (!success) return NULL;
+
+    list_remove(&win->link);
+    list_insert_after(&win_list_head, &win->link);
+
+    if (win->cfg.allow_blinking) {
+        win->blink_timer = poller_add_timer(handle_blink, win, win->cfg.blink_time);
+        poller_set_autoreset(win->blink_timer, &win->blink_timer);
+        poller_set_slack(win->blink_timer, win->cfg.blink_time);
+    }
+
+    win->redraw_borders = true;
+    screen_damage_lines(term_screen(win->term), 0, win->c.height);
+    queue_force_redraw(win);
+
+    win->vtbl->map_window(win);
+    return win;
+}
+
+void window_close(struct window *win) {
+    if (gconfig.daemon_mode && win->cfg.detach_on_close &&
+        !term_exited(win->term) && window_detach(win)) return;
+    free_window(win);
+}
+
+void window_list_detached(stats_sink_t sink, void *arg) {
+    char buffer[MAX_TITLE_LIST_LEN];
+
+    LIST_FOREACH(it, &ctx.detached) {
+        struct window *win = CONTAINEROF(it, struct window, link);
+        char *title = NULL;
+        win->vtbl->get_title(win, target_title, &title, NULL);
+        snprintf(buffer, sizeof buffer, "%"PRIu64"\t%s\n", daemon_window_id(win), title ? title : "");
+        free(title);
+        if (!sink(arg, buffer)) return;
+    }
+}
+
+static void free_window_pool(void) {
+    poller_unset(&ctx.pool_timer);
+    LIST_FOREACH_SAFE(it, &ctx.pool_profiles)
+        free_pool_profile(CONTAINEROF(it, struct pool_profile, link));
+    LIST_FOREACH_SAFE(it, &ctx.window_pool)
+        free_window(CONTAINEROF(it, struct window, link));
+}
+
 static void dump_window_geometry(struct window *win) {
     struct extent pos = window_get_position(win);
     struct extent size = window_get_size(win);
     int32_t workspace = -1;
-    if (pvtbl->get_workspace)
-        workspace = pvtbl->get_workspace(win);
+    if (win->vtbl->get_workspace)
+        workspace = win->vtbl->get_workspace(win);
 
     char path[PATH_MAX];
     snprintf(path, sizeof path, "%s.%d", win->cfg.save_geometry_path, getpid());
@@ -670,7 +1296,7 @@ static void dump_window_geometry(struct window *win) {
 
 void free_window(struct window *win) {
 
-    if (win->cfg.save_geometry_path)
+    if (win->cfg.save_geometry_path && win->vtbl == pvtbl)
         dump_window_geometry(win);
 
     poller_unset(&win->frame_timer);
@@ -684,16 +1310,19 @@ void free_window(struct window *win) {
     poller_unset(&win->read_delay_timer);
     poller_unset(&win->redraw_delay_timer);
 
-    pvtbl->free_window(win);
+    win->vtbl->free_window(win);
+
+    if (ctx.input_window == win)
+        ctx.input_window = NULL;
 
-    if (win->link.next)
+    if (win->link.next) {
         list_remove(&win->link);
+        if (gconfig.daemon_mode)
+            daemon_report_load();
+    }
     if (win->term)
         free_term(win->term);
-    if (win->font_cache)
-        free_glyph_cache(win->font_cache);
-    if (win->font)
-        free_font(win->font);
+    release_shared_cache(win);
 
     for (size_t i = 0; i < clip_MAX; i++)
         free(win->clipped[i]);
@@ -710,6 +1339,7 @@ void free_window(struct window *win) {
 #endif
 
     free_config(&win->cfg);
+    free(win->blink_rows);
     free(win);
     xtrim_heap();
 }
@@ -731,7 +1361,14 @@ bool window_submit_screen(struct window *win, int16_t cur_x, ssize_t cur_y, bool
         poller_set_timer(&win->blink_inhibit_timer, handle_blink_inhibit_timeout, win, win->cfg.blink_time/3);
         win->rcstate.cursor_blink_inhibit = true;
     }
-    return pvtbl->submit_screen(win, cur_x, cur_y, cursor_visible, marg);
+
+    struct timespec start;
+    stats_begin(&start);
+    bool drawn = win->vtbl->submit_screen(win, cur_x, cur_y, cursor_visible, marg);
+    stats_end(&win->stats, stat_submit, &start);
+    win->last_cursor_row = cur_y;
+    stats_add(&win->stats, stat_frames, drawn);
+    return drawn;
 }
 
 void window_shift(struct window *win, int16_t ys, int16_t yd, int16_t height) {
@@ -747,7 +1384,7 @@ void window_shift(struct window *win, int16_t ys, int16_t yd, int16_t height) {
     int16_t xs = win->cfg.border.left;
     int16_t width = win->c.width*win->char_width;
 
-    pvtbl->copy(win, (struct rect){xs, yd, width, height}, xs, ys);
+    win->vtbl->copy(win, (struct rect){xs, yd, width, height}, xs, ys);
 }
 
 void handle_resize(struct window *win, int16_t width, int16_t height, bool artificial) {
@@ -774,7 +1411,7 @@ void handle_resize(struct window *win, int16_t width, int16_t height, bool artif
     }
 
     if (width != win->w.width || height != win->w.height || grid_changed)
-        pvtbl->resize(win, width, height, new.width, new.height, artificial);
+        win->vtbl->resize(win, width, height, new.width, new.height, artificial);
 
 }
 
@@ -784,7 +1421,12 @@ void handle_focus(struct window *win, bool focused) {
 }
 
 void window_paste_clip(struct window *win, enum clip_target target) {
-    pvtbl->paste(win, target);
+    win->vtbl->paste(win, target);
+}
+
+void window_resume_paste(struct window *win) {
+    if (win->vtbl->resume_paste)
+        win->vtbl->resume_paste(win);
 }
 
 static void clip_copy(struct window *win, bool uri) {
@@ -924,6 +1566,12 @@ void handle_keydown(struct window *win, struct xkb_state *state, xkb_keycode_t k
         return;
     }
 
+    if (UNLIKELY(gconfig.trace_latency))
+        window_trace_latency(win, latency_keypress);
+
+    ctx.input_window = win;
+    clock_gettime(CLOCK_TYPE, &ctx.input_time);
+
     keyboard_handle_input(key, win->term);
 }
 
@@ -932,12 +1580,191 @@ bool window_is_mapped(struct window *win) {
     return win->mapped;
 }
 
+struct stats *window_stats(struct window *win) {
+    return &win->stats;
+}
+
+uint32_t window_id(struct window *win) {
+    return win->id;
+}
+
+size_t window_count(void) {
+    size_t count = 0;
+    LIST_FOREACH(it, &win_list_head)
+        count++;
+    return count;
+}
+
+void window_dump_stats(stats_sink_t sink, void *arg) {
+    char buffer[STATS_BUFFER_SIZE], name[32];
+
+    stats_format(&ctx.stats, "Global", buffer, sizeof buffer);
+    if (!sink(arg, buffer)) return;
+
+    size_t i = 0;
+    LIST_FOREACH(it, &win_list_head) {
+        struct window *win = CONTAINEROF(it, struct window, link);
+        snprintf(name, sizeof name, "Window %zu", i++);
+        stats_format(&win->stats, name, buffer, sizeof buffer);
+        if (!sink(arg, buffer)) return;
+    }
+
+    LIST_FOREACH(it, &ctx.detached) {
+        struct window *win = CONTAINEROF(it, struct window, link);
+        snprintf(name, sizeof name, "Detached window %zu", i++);
+        stats_format(&win->stats, name, buffer, sizeof buffer);
+        if (!sink(arg, buffer)) return;
+    }
+}
+
+static void finish_latency_trace(struct window *win) {
+    static const enum stat_timer timers[latency_MAX] = {
+        [latency_written] = stat_key_write,
+        [latency_echoed] = stat_key_echo,
+        [latency_drawn] = stat_key_draw,
+        [latency_vblank] = stat_key_vblank,
+    };
+
+    struct timespec *stamps = win->latency_stamps;
+    enum latency_stage last = win->latency_stage;
+    int64_t stages[latency_MAX] = {0};
+
+    for (enum latency_stage i = latency_written; i <= last; i++) {
+        stages[i] = ts_diff(&stamps[i - 1], &stamps[i]);
+        stats_record(&win->stats, timers[i], stages[i]);
+    }
+
+    int64_t total = ts_diff(&stamps[latency_keypress], &stamps[last]);
+    stats_record(&win->stats, stat_key_total, total);
+    win->latency_pending = false;
+
+    info("Latency: total=%.3fms write=%.3fms echo=%.3fms draw=%.3fms vblank=%.3fms (p50<%.3fms p99<%.3fms)",
+         total / 1000000., stages[latency_written] / 1000000., stages[latency_echoed] / 1000000.,
+         stages[latency_drawn] / 1000000., stages[latency_vblank] / 1000000.,
+         stats_percentile(&win->stats, stat_key_total, 500) / 1000.,
+         stats_percentile(&win->stats, stat_key_total, 990) / 1000.);
+}
+
+void window_trace_latency(struct window *win, enum latency_stage stage) {
+    /* Every stage is matched with the first event of
+     * the next stage, key press restarts the trace */
+    if (stage == latency_keypress)
+        win->latency_pending = true;
+    else if (!win->latency_pending || win->latency_stage + 1 != stage)
+        return;
+
+    struct timespec *stamps = win->latency_stamps;
+    clock_gettime(CLOCK_MONOTONIC, &stamps[stage]);
+    win->latency_stage = stage;
+
+    /* Input was probably not echoed, give up */
+    if (stage == latency_echoed && ts_diff(&stamps[latency_keypress], &stamps[stage]) > SEC)
+        win->latency_pending = false;
+}
+
+static bool stderr_sink(void *arg, const char *str) {
+    (void)arg;
+    return fputs(str, stderr) >= 0;
+}
+
+static inline bool window_is_visible(struct window *win) {
+    return win->mapped && !win->obscured;
+}
+
+static void update_visibility(struct window *win, bool was_visible) {
+    bool visible = window_is_visible(win);
+    if (visible == was_visible) return;
+
+    if (gconfig.trace_misc)
+        info("Window became %s", visible ? "visible" : "invisible");
+
+    /* Nothing is drawn while window is invisible,
+     * so everything needs to be repainted once */
+    if (visible && win->term) {
+        screen_damage_lines(term_screen(win->term), 0, win->c.height);
+        queue_force_redraw(win);
+    }
+}
+
+void window_set_mapped(struct window *win, bool mapped) {
+    bool was_visible = window_is_visible(win);
+    win->mapped = mapped;
+    update_visibility(win, was_visible);
+}
+
+void window_set_obscured(struct window *win, bool obscured) {
+    bool was_visible = window_is_visible(win);
+    win->obscured = obscured;
+    update_visibility(win, was_visible);
+}
+
 static bool handle_frame(void *win_) {
     struct window *win = win_;
     dec_render_inhibit(win);
     return false;
 }
 
+static bool handle_present_timeout(void *win_) {
+    struct window *win = win_;
+    /* Presentation was not reported in time, e.g. the display
+     * is slower than --fps or the event was lost. Keep drawing,
+     * frames are paced by the timer until the feedback arrives. */
+    dec_render_inhibit(win);
+    win->frame_stalled = true;
+    win->frame_feedback_pending = false;
+    stats_add(&win->stats, stat_frames_dropped, 1);
+    return false;
+}
+
+void window_frame_submitted(struct window *win) {
+    clock_gettime(CLOCK_MONOTONIC, &win->frame_submit_time);
+    win->frame_feedback_pending = true;
+
+    /* Frame timer holds one render inhibit while it is active */
+    int64_t timeout = win->cfg.fps ? 4*SEC/win->cfg.fps : SEC/10;
+    if (!poller_set_timer(&win->frame_timer, handle_present_timeout, win, timeout))
+        inc_render_inhibit(win);
+}
+
+void window_frame_presented(struct window *win, struct timespec *when) {
+    if (!win->frame_feedback_pending) {
+        /* Late feedback, next frame is paced by vblank again */
+        win->frame_stalled = false;
+        return;
+    }
+
+    /* Vblank before the submission was requested for an earlier frame */
+    if (when && ts_diff(&win->frame_submit_time, when) < 0) return;
+
+    win->frame_feedback_pending = false;
+    if (!poller_unset(&win->frame_timer)) return;
+    dec_render_inhibit(win);
+
+    struct timespec now;
+    if (!when) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        when = &now;
+    }
+
+    int64_t latency = MAX(0, ts_diff(&win->frame_submit_time, when));
+    stats_record(&win->stats, stat_vblank, latency);
+    if (win->vblank_latency)
+        win->vblank_latency += (latency - win->vblank_latency) / 8;
+    else
+        win->vblank_latency = latency;
+
+    if (gconfig.trace_misc) {
+        info("Vblank after frame, latency=%.3fms average=%.3fms",
+             latency / 1000000., win->vblank_latency / 1000000.);
+    }
+
+    if (UNLIKELY(win->latency_pending) && win->latency_stage == latency_drawn) {
+        win->latency_stamps[latency_vblank] = *when;
+        win->latency_stage = latency_vblank;
+        finish_latency_trace(win);
+    }
+}
+
 static void window_check_sigchld(void) {
 
     block_sigchld(true);
@@ -949,9 +1776,106 @@ static void window_check_sigchld(void) {
             term_hang(win->term);
     }
 
+    LIST_FOREACH_SAFE(it, &ctx.detached) {
+        struct window *win = CONTAINEROF(it, struct window, link);
+        if (UNLIKELY(term_exited(win->term)))
+            term_hang(win->term);
+    }
+
+    /* Nobody has seen pooled windows yet, so don't keep them on exit */
+    LIST_FOREACH_SAFE(it, &ctx.window_pool) {
+        struct window *win = CONTAINEROF(it, struct window, link);
+        if (UNLIKELY(term_exited(win->term)))
+            free_window(win);
+    }
+
     block_sigchld(false);
 }
 
+/* Rasterizes likely used glyphs for glyph caches in use ahead of time.
+ * This is done in short slices when no window is waiting to be redrawn,
+ * poller handles input and timers between slices. */
+static void prewarm_glyph_caches(bool yield) {
+    size_t total = face_MAX*ctx.prewarm_count;
+    if (!total) return;
+
+    LIST_FOREACH(it, &win_list_head) {
+        struct window *win = CONTAINEROF(it, struct window, link);
+        /* Poller will be woken up when the frame can be drawn */
+        if (window_is_visible(win) && (win->any_event_happened || win->blink_damaged || win->force_redraw)) return;
+    }
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_TYPE, &start);
+
+    for (ht_iter_t it = ht_begin(&ctx.caches); ht_current(&it); ht_next(&it)) {
+        struct shared_cache *cache = (struct shared_cache *)ht_current(&it);
+        if (!cache->users) continue;
+
+        while (cache->prewarm_pos < total) {
+            if (yield) {
+                poller_skip_wait();
+                return;
+            }
+
+            size_t i = cache->prewarm_pos++;
+            if (!glyph_cache_prewarm(cache->cache, ctx.prewarm_chars[i % ctx.prewarm_count], i / ctx.prewarm_count)) {
+                if (gconfig.trace_fonts)
+                    info("Font cache '%s' is full, stopping prewarming", cache->font->name);
+                cache->prewarm_pos = total;
+            }
+
+            clock_gettime(CLOCK_TYPE, &now);
+            yield = ts_diff(&start, &now) >= PREWARM_SLICE;
+        }
+    }
+}
+
+static bool redraw_window(struct window *win) {
+    /* Terminal keeps parsing, but nothing is rendered */
+    if (!window_is_visible(win)) return false;
+
+    bool drawn = false;
+    if (((win->any_event_happened || win->blink_damaged) && !win->inhibit_render_counter) || win->force_redraw) {
+        /* Nothing but blinking changed, so other rows do not need to be scanned */
+        win->partial_redraw = !win->any_event_happened && !win->force_redraw;
+
+        /* Rendering is charged against the same budget as parsing */
+        struct timespec start;
+        clock_gettime(CLOCK_TYPE, &start);
+        win->drawn_something = screen_redraw(term_screen(win->term), win->blink_committed);
+        charge_window_time(win, &start);
+
+        if (win->drawn_something) {
+            drawn = true;
+            if (UNLIKELY(win->latency_pending))
+                window_trace_latency(win, latency_drawn);
+
+            /* Feedback is still requested while stalled to notice when it is back */
+            bool feedback = win->cfg.vsync && win->vtbl->request_frame && win->vtbl->request_frame(win);
+            if (feedback && !win->frame_stalled) {
+                /* Next frame will be drawn after this one is displayed */
+                window_frame_submitted(win);
+            } else {
+                if (win->cfg.fps && !poller_set_timer(&win->frame_timer, handle_frame, win, SEC/win->cfg.fps))
+                    inc_render_inhibit(win);
+                /* No presentation feedback, trace ends here */
+                if (UNLIKELY(win->latency_pending) && win->latency_stage == latency_drawn)
+                    finish_latency_trace(win);
+            }
+            window_reset_delayed_redraw(win);
+            if (gconfig.trace_misc) info("Redraw");
+        }
+
+        win->force_redraw = false;
+        win->any_event_happened = false;
+        win->blink_damaged = false;
+        win->partial_redraw = false;
+    }
+
+    return drawn;
+}
+
 static void tick(void *arg) {
     (void)arg;
 
@@ -964,27 +1888,39 @@ static void tick(void *arg) {
     if (reload_config)
         do_reload_config();
 
+    if (dump_stats) {
+        dump_stats = 0;
+        window_dump_stats(stderr_sink, NULL);
+    }
+
     /* Perform redraw here so that it happens after the read from the terminal */
+    bool drawn = false;
 
+    LIST_FOREACH(it, &ctx.detached)
+        refill_read_credit(CONTAINEROF(it, struct window, link));
+    LIST_FOREACH(it, &win_list_head)
+        refill_read_credit(CONTAINEROF(it, struct window, link));
+
+    /* Windows receiving input are drawn first to reduce latency */
     LIST_FOREACH(it, &win_list_head) {
         struct window *win = CONTAINEROF(it, struct window, link);
-
-        if ((win->any_event_happened && !win->inhibit_render_counter) || win->force_redraw) {
-            if ((win->drawn_something = screen_redraw(term_screen(win->term), win->blink_committed))) {
-                if (win->cfg.fps && !poller_set_timer(&win->frame_timer, handle_frame, win, SEC/win->cfg.fps))
-                    inc_render_inhibit(win);
-                window_reset_delayed_redraw(win);
-                if (gconfig.trace_misc) info("Redraw");
-            }
-
-            win->force_redraw = false;
-            win->any_event_happened = false;
-        }
+        if (window_is_interactive(win))
+            drawn |= redraw_window(win);
+    }
+    LIST_FOREACH(it, &win_list_head) {
+        struct window *win = CONTAINEROF(it, struct window, link);
+        if (!window_is_interactive(win))
+            drawn |= redraw_window(win);
     }
 
     if (UNLIKELY(had_sigchld))
         window_check_sigchld();
 
+    struct timespec start;
+    stats_begin(&start);
     pvtbl->flush();
+    stats_end(&ctx.stats, stat_flush, &start);
 
+    /* Let poller handle pending input after drawing a frame */
+    prewarm_glyph_caches(drawn);
 }
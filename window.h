@@ -7,6 +7,7 @@
 
 #include "font.h"
 #include "config.h"
+#include "stats.h"
 #include "util.h"
 
 #include <stdbool.h>
@@ -14,6 +15,16 @@
 #include <stdint.h>
 #include <unistd.h>
 
+/* Keypress latency tracing stages, in order */
+enum latency_stage {
+    latency_keypress,
+    latency_written,
+    latency_echoed,
+    latency_drawn,
+    latency_vblank,
+    latency_MAX,
+};
+
 /* WARNING: Order is important */
 enum mouse_event_type {
     mouse_event_press,
@@ -95,17 +106,27 @@ void init_context(struct instance_config *cfg);
 void free_context(void);
 
 struct window *create_window(struct instance_config *cfg);
+struct window *window_pool_take(struct instance_config *cfg);
 void free_window(struct window *win);
+bool window_detach(struct window *win);
+struct window *window_attach(uint32_t id);
+void window_list_detached(stats_sink_t sink, void *arg);
 
 bool window_submit_screen(struct window *win, int16_t cur_x, ssize_t cur_y, bool cursor, bool marg, bool cmoved);
 void window_shift(struct window *win, int16_t ys, int16_t yd, int16_t height);
 void window_paste_clip(struct window *win, enum clip_target target);
+void window_resume_paste(struct window *win);
 void window_delay_redraw(struct window *win);
 void window_request_scroll_flush(struct window *win);
 bool window_resize(struct window *win, int16_t width, int16_t height);
 void window_move(struct window *win, int16_t x, int16_t y);
 bool window_action(struct window *win, enum window_action act);
 bool window_is_mapped(struct window *win);
+struct stats *window_stats(struct window *win);
+void window_trace_latency(struct window *win, enum latency_stage stage);
+void window_dump_stats(stats_sink_t sink, void *arg);
+size_t window_count(void);
+uint32_t window_id(struct window *win);
 void window_bell(struct window *win, uint8_t vol);
 void window_reset_delayed_redraw(struct window *win);
 
@@ -139,11 +160,16 @@ void window_set_pointer_mode(struct window *win, enum hide_pointer_mode mode);
 void window_set_pointer_shape(struct window *win, const char *name);
 
 bool init_daemon(void);
+bool start_daemon(void);
 void free_daemon(void);
+bool daemon_is_dispatcher(void);
+void daemon_report_load(void);
+uint64_t daemon_window_id(struct window *win);
 bool daemon_process_clients(void);
 
 extern struct instance_config global_instance_config;
 
 void x11_xrender_release_glyph(struct glyph *);
+void x11_xrender_release_glyph_set(uint32_t gsid);
 
 #endif